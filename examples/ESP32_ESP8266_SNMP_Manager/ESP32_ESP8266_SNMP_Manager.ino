@@ -53,7 +53,8 @@ unsigned long intervalBetweenPolls = 0;
 float bandwidthInUtilPct = 0;
 unsigned int lastInOctets = 0;
 // SNMP Objects
-WiFiUDP udp;                                           // UDP object used to send and receive packets
+WiFiUDP udp;                                           // UDP object used to listen for traps on port 162
+WiFiUDP udpRequest;                                    // UDP object used to send requests and receive their responses
 SNMPManager snmp = SNMPManager(community);             // Starts an SNMPManager to listen to replies to get-requests
 SNMPGet snmpRequest = SNMPGet(community, snmpVersion); // Starts an SNMPGet instance to send requests
 // Blank callback pointer for each OID
@@ -90,8 +91,9 @@ void setup()
   Serial.print("IP address: ");
   Serial.println(WiFi.localIP());
 
-  snmp.setUDP(&udp); // give snmp a pointer to the UDP object
-  snmp.begin();      // start the SNMP Manager
+  snmp.setUDP(&udp);               // give snmp a pointer to the UDP object
+  snmp.begin();                    // start the SNMP Manager
+  snmp.addRequestUDP(&udpRequest); // dedicated ephemeral port socket for requests and responses
 
   // Get callbacks from creating a handler for each of the OID
   callbackIfSpeed = snmp.addGaugeHandler(router, oidIfSpeedGauge, &ifSpeedResponse);
@@ -160,7 +162,7 @@ void getSNMP()
 
   snmpRequest.setIP(WiFi.localIP()); // IP of the listening MCU
   // snmpRequest.setPort(501);  // Default is UDP port 161 for SNMP. But can be overriden if necessary.
-  snmpRequest.setUDP(&udp);
+  snmpRequest.setUDP(snmp.requestUDP());
   snmpRequest.setRequestID(rand() % 5555);
   snmpRequest.sendTo(router);
   snmpRequest.clearOIDList();
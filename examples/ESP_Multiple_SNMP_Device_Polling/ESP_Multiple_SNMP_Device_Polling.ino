@@ -28,7 +28,6 @@ const char *oidUptime = ".1.3.6.1.2.1.1.3.0";  // TimeTicks uptime (hundredths o
 //* Settings                         *
 //************************************
 int devicePollInterval = 100;    // delay in milliseconds
-int lastDeviceWaitPeriod = 5000; // delay in milliseconds
 #define LOWEROCTETLIMIT 1        // Set the lowest IP address to 1, .0 typically isn't used and isn't well supported.
 #define UPPEROCTETLIMIT 6        // Set the upper limit of the range of IPs to query
 //************************************
@@ -49,14 +48,14 @@ struct device
 struct device deviceRecords[UPPEROCTETLIMIT + 1]; // Array of device records. _1 as we're not using the 0 index in the array.
 int lastOctet = LOWEROCTETLIMIT;                  // Initialise last octet to lowest IP
 bool allDevicesPolled = false;                    // Flag to to indicate all devices have been sent SNMP requests. Note responses may not yet have arrived.
+int devicesAwaiting = 0;                          // Requests sent that have not yet been answered or timed out
 // Initialise variables used for timer counters to zero.
 unsigned long devicePollStart = 0;
 unsigned long intervalBetweenDevicePolls = 0;
-unsigned long intervalBetweenLastDeviceReadyPolls = 0;
-unsigned long deviceReadyStart = 0;
 
 // SNMP Objects
-WiFiUDP udp;                                           // UDP object used to send and receive packets
+WiFiUDP udp;                                           // UDP object used to listen for traps on port 162
+WiFiUDP udpRequest;                                    // UDP object used to send requests and receive their responses
 SNMPManager snmp = SNMPManager(community);             // Starts an SNMPManager to listen to replies to get-requests
 SNMPGet snmpRequest = SNMPGet(community, snmpVersion); // Starts an SNMPGet instance to send requests
 ValueCallback *callbackSysName;                        // Callback pointer for each OID
@@ -67,6 +66,7 @@ ValueCallback *callbackUptime;                         // Callback pointer for e
 //* Function declarations            *
 //************************************
 void sendSNMPRequest(IPAddress, struct device *deviceRecord);
+void requestComplete(SNMPGet *request, IPAddress ip, bool ok);
 int getNextOctet(int current);
 void printVariableValues();
 //************************************
@@ -85,22 +85,25 @@ void setup()
   Serial.printf("\nConnected to SSID: %s - IP Address: ", ssid);
   Serial.println(WiFi.localIP());
 
-  snmp.setUDP(&udp); // give snmp a pointer to the UDP object
-  snmp.begin();      // start the SNMP Manager
+  snmp.setUDP(&udp);               // give snmp a pointer to the UDP object
+  snmp.begin();                    // start the SNMP Manager
+  snmp.addRequestUDP(&udpRequest); // dedicated ephemeral port socket for requests and responses
+
+  snmpRequest.setManager(&snmp);                    // track requests so their completion is reported
+  snmpRequest.setCompleteCallback(requestComplete); // called once each device has answered or timed out
 }
 
 void loop()
 {
-  snmp.loop();                                                       // Needs to be called frequently to process incoming SNMP responses.
-  intervalBetweenDevicePolls = millis() - devicePollStart;           // Timer for triggering per device Polls
-  intervalBetweenLastDeviceReadyPolls = millis() - deviceReadyStart; // Timer to trigger end of polling all devices (allowing some time for final packets to be processed)
+  snmp.loop();                                             // Needs to be called frequently to process incoming SNMP responses.
+  intervalBetweenDevicePolls = millis() - devicePollStart; // Timer for triggering per device Polls
   if (allDevicesPolled)
   {
-    if (intervalBetweenLastDeviceReadyPolls > lastDeviceWaitPeriod) // Waiting time after all devices polled complete?
+    if (devicesAwaiting == 0) // Every device has answered or timed out?
     {
-      deviceReadyStart += lastDeviceWaitPeriod; // This prevents drift in the delays
-      printVariableValues();                    // Print the values to the serial console
-      allDevicesPolled = false;                 // Reset the flag
+      devicePollStart = millis();
+      printVariableValues();    // Print the values to the serial console
+      allDevicesPolled = false; // Reset the flag
     }
   }
   else
@@ -120,7 +123,7 @@ void sendSNMPRequest(IPAddress target, struct device *deviceRecord)
   Serial.print("sendSNMPRequest - target: ");
   Serial.println(target);
   deviceRecord->address = target;
-  // Get callbacks from creating a handler for each of the OID
+  // Get callbacks from creating a handler for each of the OID. Registering the same OID again returns the existing handler, so this can be done on every poll.
   callbackSysName = snmp.addStringHandler(target, oidSysName, &deviceRecord->sysName);
   callbackUptime = snmp.addTimestampHandler(target, oidUptime, &deviceRecord->uptime);
 
@@ -129,12 +132,25 @@ void sendSNMPRequest(IPAddress target, struct device *deviceRecord)
   snmpRequest.addOIDPointer(callbackUptime);
 
   snmpRequest.setIP(WiFi.localIP()); // IP of the listening MCU
-  snmpRequest.setUDP(&udp);
+  snmpRequest.setUDP(snmp.requestUDP());
   snmpRequest.setRequestID(rand() % 5555);
-  snmpRequest.sendTo(target);
+  if (snmpRequest.sendTo(target))
+  {
+    devicesAwaiting++;
+  }
   snmpRequest.clearOIDList();
 }
 
+void requestComplete(SNMPGet *request, IPAddress ip, bool ok)
+{
+  devicesAwaiting--;
+  if (!ok)
+  {
+    Serial.print("No response from: ");
+    Serial.println(ip);
+  }
+}
+
 int getNextOctet(int current)
 {
   if (current == UPPEROCTETLIMIT)
@@ -0,0 +1,160 @@
+#ifndef Arduino_h
+#define Arduino_h
+
+// The parts of the Arduino core the library uses, so its headers can be compiled and tested on a host.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <chrono>
+#include <thread>
+
+typedef uint8_t byte;
+
+#define F(x) x
+#define PROGMEM
+#define HEX 16
+#define strncpy_P strncpy
+#define memcpy_P memcpy
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+
+// Time only moves when a test sets it, so timeouts and intervals are reproducible
+extern unsigned long hostMillis;
+
+inline unsigned long millis()
+{
+    return hostMillis;
+}
+
+inline void delay(unsigned long ms)
+{
+    hostMillis += ms;
+}
+
+inline void yield()
+{
+    std::this_thread::yield();
+}
+
+inline long random(long max)
+{
+    return rand() % max;
+}
+
+inline long random(long min, long max)
+{
+    return min + rand() % (max - min);
+}
+
+class IPAddress
+{
+public:
+    IPAddress() {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+    {
+        _address[0] = a;
+        _address[1] = b;
+        _address[2] = c;
+        _address[3] = d;
+    }
+    IPAddress(uint32_t address)
+    {
+        memcpy(_address, &address, 4);
+    }
+    IPAddress(const uint8_t *address)
+    {
+        memcpy(_address, address, 4);
+    }
+    operator uint32_t() const
+    {
+        uint32_t address;
+        memcpy(&address, _address, 4);
+        return address;
+    }
+    uint8_t operator[](int index) const
+    {
+        return _address[index];
+    }
+    bool operator==(const IPAddress &other) const
+    {
+        return memcmp(_address, other._address, 4) == 0;
+    }
+    bool operator!=(const IPAddress &other) const
+    {
+        return !(*this == other);
+    }
+
+private:
+    uint8_t _address[4] = {0, 0, 0, 0};
+};
+
+class String : public std::string
+{
+public:
+    String(const char *text) : std::string(text) {}
+    void toCharArray(char *buffer, unsigned int size) const
+    {
+        strncpy(buffer, c_str(), size);
+        buffer[size - 1] = 0;
+    }
+};
+
+// Prints to stdout, or nothing once quiet is set
+class HostSerial
+{
+public:
+    bool quiet = false;
+
+    template <typename T>
+    void print(const T &value, int format = 0)
+    {
+        if (!quiet)
+        {
+            write(value);
+        }
+    }
+    template <typename T>
+    void println(const T &value, int format = 0)
+    {
+        print(value);
+        println();
+    }
+    void println()
+    {
+        if (!quiet)
+        {
+            ::printf("\n");
+        }
+    }
+    template <typename... Args>
+    void printf(const char *format, Args... args)
+    {
+        if (!quiet)
+        {
+            ::printf(format, args...);
+        }
+    }
+
+private:
+    void write(const char *text) { ::printf("%s", text); }
+    void write(char c) { ::printf("%c", c); }
+    void write(const String &text) { ::printf("%s", text.c_str()); }
+    void write(const IPAddress &ip) { ::printf("%d.%d.%d.%d", ip[0], ip[1], ip[2], ip[3]); }
+    void write(long long value) { ::printf("%lld", value); }
+    void write(unsigned long long value) { ::printf("%llu", value); }
+    void write(int value) { write((long long)value); }
+    void write(long value) { write((long long)value); }
+    void write(short value) { write((long long)value); }
+    void write(unsigned int value) { write((unsigned long long)value); }
+    void write(unsigned long value) { write((unsigned long long)value); }
+    void write(unsigned short value) { write((unsigned long long)value); }
+    void write(unsigned char value) { write((unsigned long long)value); }
+    void write(bool value) { write((long long)value); }
+    void write(double value) { ::printf("%f", value); }
+};
+
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef udp_h
+#define udp_h
+
+#include "Arduino.h"
+
+class UDP
+{
+public:
+    virtual ~UDP() {}
+    virtual uint8_t begin(uint16_t port) = 0;
+    virtual void stop() = 0;
+    virtual int beginPacket(IPAddress ip, uint16_t port) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+    virtual int endPacket() = 0;
+    virtual int parsePacket() = 0;
+    virtual int available() = 0;
+    virtual int read(unsigned char *buffer, size_t length) = 0;
+    virtual void flush() = 0;
+    virtual IPAddress remoteIP() = 0;
+    virtual uint16_t remotePort() = 0;
+};
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef host_h
+#define host_h
+
+// Host tests of the library, run on Linux with no board. Each test is one file, built and run from the library folder with:
+//
+//     g++ -std=gnu++17 -pthread -I extras/test -I src extras/test/test_codec.cpp -o /tmp/test_codec && /tmp/test_codec
+//
+// A test prints each failed check and exits non-zero if there were any.
+
+#include "Arduino.h"
+
+unsigned long hostMillis = 0;
+HostSerial Serial;
+
+#include "Arduino_SNMP_Manager.h"
+#include <deque>
+#include <utility>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if (!(condition))                                                   \
+        {                                                                   \
+            ::printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition);   \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+inline int testResult()
+{
+    ::printf(failures ? "%d failed\n" : "passed\n", failures);
+    return failures ? 1 : 0;
+}
+
+// Hex of bytes, as "02 01 00"
+inline std::string hexBytes(const unsigned char *data, int length)
+{
+    std::string text;
+    char byte[4];
+    for (int i = 0; i < length; i++)
+    {
+        snprintf(byte, sizeof(byte), i ? " %02x" : "%02x", data[i]);
+        text += byte;
+    }
+    return text;
+}
+
+// Datagrams queued by the test are received, those sent are kept
+class HostUDP : public UDP
+{
+public:
+    struct Datagram
+    {
+        IPAddress ip;
+        uint16_t port;
+        std::vector<uint8_t> data;
+    };
+    std::deque<Datagram> received;
+    std::vector<Datagram> sent;
+
+    uint8_t begin(uint16_t port) { return 1; }
+    void stop() {}
+    int beginPacket(IPAddress ip, uint16_t port)
+    {
+        _sending = Datagram{ip, port, {}};
+        return 1;
+    }
+    size_t write(const uint8_t *buffer, size_t size)
+    {
+        _sending.data.insert(_sending.data.end(), buffer, buffer + size);
+        return size;
+    }
+    int endPacket()
+    {
+        sent.push_back(_sending);
+        return 1;
+    }
+    int parsePacket()
+    {
+        if (received.empty())
+        {
+            return 0;
+        }
+        _current = received.front();
+        received.pop_front();
+        _position = 0;
+        return _current.data.size();
+    }
+    int available()
+    {
+        return _current.data.size() - _position;
+    }
+    int read(unsigned char *buffer, size_t length)
+    {
+        size_t count = std::min(length, _current.data.size() - _position);
+        memcpy(buffer, _current.data.data() + _position, count);
+        _position += count;
+        return count;
+    }
+    void flush()
+    {
+        _position = _current.data.size();
+    }
+    IPAddress remoteIP()
+    {
+        return _current.ip;
+    }
+    uint16_t remotePort()
+    {
+        return _current.port;
+    }
+
+    void receive(IPAddress from, const std::vector<uint8_t> &data)
+    {
+        received.push_back(Datagram{from, 161, data});
+    }
+
+private:
+    Datagram _sending;
+    Datagram _current;
+    size_t _position = 0;
+};
+
+// A v1/v2c GetResponse with the varbinds given, the values are deleted with it
+inline std::vector<uint8_t> getResponse(const char *community, unsigned long requestID, std::vector<std::pair<const char *, BER_CONTAINER *>> varBinds)
+{
+    ComplexType message(STRUCTURE);
+    message.addValueToList(new IntegerType(1));
+    message.addValueToList(new OctetType((char *)community));
+    ComplexType *pdu = new ComplexType(GetResponsePDU);
+    pdu->addValueToList(new IntegerType(requestID));
+    pdu->addValueToList(new IntegerType(0));
+    pdu->addValueToList(new IntegerType(0));
+    ComplexType *list = new ComplexType(STRUCTURE);
+    for (auto &varBind : varBinds)
+    {
+        ComplexType *item = new ComplexType(STRUCTURE);
+        item->addValueToList(new OIDType((char *)varBind.first));
+        item->addValueToList(varBind.second);
+        list->addValueToList(item);
+    }
+    pdu->addValueToList(list);
+    message.addValueToList(pdu);
+    static unsigned char buffer[16384];
+    int length = message.serialise(buffer);
+    return std::vector<uint8_t>(buffer, buffer + length);
+}
+
+#endif
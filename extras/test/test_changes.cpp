@@ -0,0 +1,105 @@
+// Change generations and dirty bitmaps: forEachChanged() must report exactly the handlers changed since the generation given.
+//
+//     g++ -std=gnu++17 -pthread -I extras/test -I src extras/test/test_changes.cpp -o /tmp/test_changes && /tmp/test_changes
+
+#include "host.h"
+#include <set>
+
+#define AGENTS 4
+#define HANDLERS 500
+#define CYCLES 2000
+
+static std::set<ValueCallback *> reported;
+
+static void collect(IPAddress ip, ValueCallback *callback)
+{
+    reported.insert(callback);
+}
+
+int main()
+{
+    SNMPManager snmp("public");
+    HostUDP udp;
+    snmp.setUDP(&udp);
+    static uint32_t values[AGENTS][HANDLERS];
+    static char oids[HANDLERS][32];
+    ValueCallback *handlers[AGENTS][HANDLERS];
+    for (int i = 0; i < HANDLERS; i++)
+    {
+        snprintf(oids[i], sizeof(oids[i]), ".1.3.6.1.2.1.2.2.1.10.%d", i + 1);
+    }
+    for (int agent = 0; agent < AGENTS; agent++)
+    {
+        for (int i = 0; i < HANDLERS; i++)
+        {
+            handlers[agent][i] = snmp.addCounter32Handler(IPAddress(10, 0, 0, agent + 1), oids[i], &values[agent][i]);
+        }
+    }
+
+    // One consumer reads every cycle, using the bitmaps. Another reads every 7 cycles, from a generation older than the last
+    // call, so falls back to checking the handlers of the agents that changed.
+    uint32_t seenEvery = 0, seenSeventh = 0;
+    srand(1);
+    for (int cycle = 1; cycle <= CYCLES; cycle++)
+    {
+        int agent = rand() % AGENTS;
+        std::set<ValueCallback *> changed;
+        std::vector<std::pair<const char *, BER_CONTAINER *>> varBinds;
+        for (int k = 1 + rand() % 3; k > 0; k--)
+        {
+            int i = rand() % HANDLERS;
+            varBinds.push_back({oids[i], new Counter32(cycle * 10 + k)});
+            changed.insert(handlers[agent][i]);
+        }
+        udp.receive(IPAddress(10, 0, 0, agent + 1), getResponse("public", cycle, varBinds));
+        snmp.loop();
+        CHECK(snmp.generation() == (uint32_t)cycle);
+
+        reported.clear();
+        uint32_t generation = snmp.generation();
+        CHECK(snmp.forEachChanged(seenEvery, collect) == (int)changed.size());
+        CHECK(reported == changed);
+        seenEvery = generation;
+
+        if (cycle % 7 == 0)
+        {
+            std::set<ValueCallback *> expected;
+            for (int a = 0; a < AGENTS; a++)
+            {
+                for (int i = 0; i < HANDLERS; i++)
+                {
+                    if (handlers[a][i]->generation > seenSeventh)
+                    {
+                        expected.insert(handlers[a][i]);
+                    }
+                }
+            }
+            reported.clear();
+            snmp.forEachChanged(seenSeventh, collect);
+            CHECK(reported == expected);
+            seenSeventh = generation;
+        }
+        if (failures)
+        {
+            ::printf("at cycle %d\n", cycle);
+            break;
+        }
+    }
+
+    // The same values again change nothing, so the generation stays put and nothing is reported
+    uint32_t generation = snmp.generation();
+    udp.receive(IPAddress(10, 0, 0, 1), getResponse("public", 1, {{oids[0], new Counter32(values[0][0])}}));
+    snmp.loop();
+    CHECK(snmp.generation() == generation);
+    CHECK(snmp.forEachChanged(generation, collect) == 0);
+
+    // A removed handler is no longer reported
+    udp.receive(IPAddress(10, 0, 0, 1), getResponse("public", 2, {{oids[5], new Counter32(1)}, {oids[6], new Counter32(1)}}));
+    snmp.loop();
+    snmp.removeHandler(handlers[0][5]);
+    reported.clear();
+    CHECK(snmp.forEachChanged(generation, collect) == 1);
+    CHECK(reported.size() == 1 && reported.count(handlers[0][6]) == 1);
+
+    return testResult();
+}
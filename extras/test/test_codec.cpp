@@ -0,0 +1,115 @@
+// Known encodings of the integer types, round trips of edge values, and a benchmark of the shared codec.
+//
+//     g++ -std=gnu++17 -O2 -pthread -I extras/test -I src extras/test/test_codec.cpp -o /tmp/test_codec && /tmp/test_codec
+
+#include "host.h"
+
+// Serialises the value, checks it against the expected bytes, then decodes those into a fresh container of the same type
+template <class Container>
+static Container decodeEncoding(Container &value, const char *expected)
+{
+    unsigned char buffer[16];
+    int length = value.serialise(buffer);
+    std::string encoded = hexBytes(buffer, length);
+    if (encoded != expected)
+    {
+        ::printf("FAIL encoded %s, expected %s\n", encoded.c_str(), expected);
+        failures++;
+    }
+    Container decoded;
+    decoded.fromBuffer(buffer);
+    return decoded;
+}
+
+static void testKnownEncodings()
+{
+    IntegerType zero(0);
+    CHECK(decodeEncoding(zero, "02 01 00")._value == 0);
+    IntegerType small(127);
+    CHECK(decodeEncoding(small, "02 01 7f")._value == 127);
+    IntegerType padded(128);
+    CHECK(decodeEncoding(padded, "02 02 00 80")._value == 128);
+    IntegerType minusOne((unsigned long)-1L);
+    CHECK((long)decodeEncoding(minusOne, "02 01 ff")._value == -1);
+    IntegerType minus128((unsigned long)-128L);
+    CHECK((long)decodeEncoding(minus128, "02 01 80")._value == -128);
+    IntegerType minus129((unsigned long)-129L);
+    CHECK((long)decodeEncoding(minus129, "02 02 ff 7f")._value == -129);
+    IntegerType largest(0x7FFFFFFF);
+    CHECK(decodeEncoding(largest, "02 04 7f ff ff ff")._value == 0x7FFFFFFF);
+    IntegerType smallest((unsigned long)(long)INT32_MIN);
+    CHECK((long)decodeEncoding(smallest, "02 04 80 00 00 00")._value == INT32_MIN);
+
+    Counter32 counter(0xFFFFFFFF);
+    CHECK(decodeEncoding(counter, "41 05 00 ff ff ff ff")._value == 0xFFFFFFFF);
+    Counter32 counterPadded(0x80);
+    CHECK(decodeEncoding(counterPadded, "41 02 00 80")._value == 0x80);
+    Gauge gauge(1000000000);
+    CHECK(decodeEncoding(gauge, "42 04 3b 9a ca 00")._value == 1000000000);
+    TimestampType ticks(8573444);
+    CHECK(decodeEncoding(ticks, "43 04 00 82 d2 04")._value == 8573444);
+
+    Counter64 counter64Zero((uint64_t)0);
+    CHECK(decodeEncoding(counter64Zero, "46 01 00")._value == 0);
+    Counter64 counter64Small(200);
+    CHECK(decodeEncoding(counter64Small, "46 02 00 c8")._value == 200);
+    Counter64 counter64Top(1ULL << 63);
+    CHECK(decodeEncoding(counter64Top, "46 09 00 80 00 00 00 00 00 00 00")._value == 1ULL << 63);
+    Counter64 counter64Max(0xFFFFFFFFFFFFFFFFULL);
+    CHECK(decodeEncoding(counter64Max, "46 09 00 ff ff ff ff ff ff ff ff")._value == 0xFFFFFFFFFFFFFFFFULL);
+}
+
+static void testLaxDecoding()
+{
+    // Some agents send unsigned values without the leading zero, or signed values with redundant padding
+    unsigned char unpadded[] = {0x41, 0x04, 0xff, 0xff, 0xff, 0xff};
+    Counter32 counter;
+    counter.fromBuffer(unpadded);
+    CHECK(counter._value == 0xFFFFFFFF);
+    unsigned char overPadded[] = {0x02, 0x03, 0x00, 0x00, 0x05};
+    IntegerType integer;
+    integer.fromBuffer(overPadded);
+    CHECK(integer._value == 5);
+}
+
+static void testSignedRoundTrips()
+{
+    for (long value = -70000; value < 70000; value += 7)
+    {
+        unsigned char buffer[8];
+        berWriteInteger(buffer, INTEGER, value);
+        CHECK(berReadInteger(buffer + 2, buffer[1]) == value);
+        // Minimal: the first content byte is never just the sign of the second
+        bool redundant = buffer[1] > 1 && ((buffer[2] == 0x00 && !(buffer[3] & 0x80)) || (buffer[2] == 0xFF && (buffer[3] & 0x80)));
+        CHECK(!redundant);
+        if (failures)
+        {
+            ::printf("at %ld\n", value);
+            return;
+        }
+    }
+}
+
+static void benchmark()
+{
+    const unsigned long count = 5000000;
+    unsigned char buffer[16];
+    unsigned long sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < count; i++)
+    {
+        int length = berEncodeInteger<unsigned long>(buffer, COUNTER32, (uint32_t)(i * 2654435761u), false);
+        sum += berDecodeInteger<unsigned long>(buffer + 2, buffer[1], false) + length;
+    }
+    double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    ::printf("Counter32 encode and decode: %.1f ns (%lu)\n", elapsed / count, sum);
+}
+
+int main()
+{
+    testKnownEncodings();
+    testLaxDecoding();
+    testSignedRoundTrips();
+    benchmark();
+    return testResult();
+}
@@ -0,0 +1,98 @@
+// Published test vectors for the SNMPv3 security code: hashes, RFC 3414 key localisation, HMAC, and AES-128 with CFB.
+//
+//     g++ -std=gnu++17 -pthread -I extras/test -I src extras/test/test_crypto.cpp -o /tmp/test_crypto && /tmp/test_crypto
+
+#include "host.h"
+
+#define CHECK_BYTES(data, length, expected)                                                             \
+    do                                                                                                  \
+    {                                                                                                   \
+        std::string actual = hexBytes(data, length);                                                    \
+        if (actual != expected)                                                                         \
+        {                                                                                               \
+            ::printf("FAIL %s:%d: %s, expected %s\n", __FILE__, __LINE__, actual.c_str(), expected);    \
+            failures++;                                                                                 \
+        }                                                                                               \
+    } while (0)
+
+static void testHashes()
+{
+    uint8_t digest[20];
+    SNMPHash md5(SNMP_AUTH_MD5);
+    md5.update((const uint8_t *)"abc", 3);
+    md5.finish(digest);
+    CHECK_BYTES(digest, 16, "90 01 50 98 3c d2 4f b0 d6 96 3f 7d 28 e1 7f 72");
+
+    // FIPS 180 two block message, fed a byte at a time to cross the block boundary part way through an update
+    const char *message = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    SNMPHash sha(SNMP_AUTH_SHA);
+    for (size_t i = 0; i < strlen(message); i++)
+    {
+        sha.update((const uint8_t *)message + i, 1);
+    }
+    sha.finish(digest);
+    CHECK_BYTES(digest, 20, "84 98 3e 44 1c 3b d2 6e ba ae 4a a1 f9 51 29 e5 e5 46 70 f1");
+}
+
+static void testKeyLocalisation()
+{
+    // RFC 3414 A.3.1 and A.3.2: password "maplesyrup", engine ID 00 00 00 00 00 00 00 00 00 00 00 02
+    const uint8_t engineID[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2};
+    uint8_t key[20], localized[20];
+    snmpPasswordToKey(SNMP_AUTH_MD5, "maplesyrup", key);
+    CHECK_BYTES(key, 16, "9f af 32 83 88 4e 92 83 4e bc 98 47 d8 ed d9 63");
+    snmpLocalizeKey(SNMP_AUTH_MD5, key, engineID, sizeof(engineID), localized);
+    CHECK_BYTES(localized, 16, "52 6f 5e ed 9f cc e2 6f 89 64 c2 93 07 87 d8 2b");
+
+    snmpPasswordToKey(SNMP_AUTH_SHA, "maplesyrup", key);
+    CHECK_BYTES(key, 20, "9f b5 cc 03 81 49 7b 37 93 52 89 39 ff 78 8d 5d 79 14 52 11");
+    snmpLocalizeKey(SNMP_AUTH_SHA, key, engineID, sizeof(engineID), localized);
+    CHECK_BYTES(localized, 20, "66 95 fe bc 92 88 e3 62 82 23 5f c7 15 1f 12 84 97 b3 8f 3f");
+}
+
+static void testHmac()
+{
+    // RFC 2104 and RFC 2202 test case 1
+    uint8_t key[20], digest[20];
+    memset(key, 0x0b, sizeof(key));
+    SNMPHmac hmac;
+    hmac.setKey(SNMP_AUTH_MD5, key, 16);
+    hmac.compute((const uint8_t *)"Hi There", 8, digest);
+    CHECK_BYTES(digest, 16, "92 94 72 7a 36 38 bb 1c 13 f4 8e f8 15 8b fc 9d");
+    hmac.setKey(SNMP_AUTH_SHA, key, 20);
+    hmac.compute((const uint8_t *)"Hi There", 8, digest);
+    CHECK_BYTES(digest, 20, "b6 17 31 86 55 05 72 64 e2 8b c0 b6 fb 37 8c 8e f1 46 be 00");
+}
+
+static void testAes()
+{
+    // FIPS-197 C.1
+    uint8_t key[16], block[16], encrypted[16];
+    for (int i = 0; i < 16; i++)
+    {
+        key[i] = i;
+        block[i] = i * 0x11;
+    }
+    SNMPAes128 aes;
+    aes.setKey(key);
+    aes.encryptBlock(block, encrypted);
+    CHECK_BYTES(encrypted, 16, "69 c4 e0 d8 6a 7b 04 30 d8 cd b7 80 70 b4 c5 5a");
+
+    // SP800-38A F.3.13, with a partial second block as a scopedPDU usually ends with
+    const uint8_t cfbKey[16] = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+    uint8_t data[20] = {0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a, 0xae, 0x2d, 0x8a, 0x57};
+    aes.setKey(cfbKey);
+    aes.cfb(data, sizeof(data), key, false);
+    CHECK_BYTES(data, 20, "3b 3f d9 2e b7 2d ad 20 33 34 49 f8 e8 3c fb 4a c8 a6 45 37");
+    aes.cfb(data, sizeof(data), key, true);
+    CHECK_BYTES(data, 20, "6b c1 be e2 2e 40 9f 96 e9 3d 7e 11 73 93 17 2a ae 2d 8a 57");
+}
+
+int main()
+{
+    testHashes();
+    testKeyLocalisation();
+    testHmac();
+    testAes();
+    return testResult();
+}
@@ -0,0 +1,79 @@
+// Handlers registered in bulk from a const table, and from one read the PROGMEM way.
+//
+//     g++ -std=gnu++17 -pthread -I extras/test -I src extras/test/test_handler_table.cpp -o /tmp/test_handler_table && /tmp/test_handler_table
+
+#include "host.h"
+
+#define ROWS 400
+#define AGENTS 5
+
+static int values[ROWS];
+static uint32_t uptime;
+static float load;
+static char oids[ROWS][32];
+static SNMPHandlerEntry table[ROWS];
+
+static IPAddress rowIP(int row)
+{
+    return IPAddress(10, 0, row % AGENTS, 1);
+}
+
+// Every row is found where the table put it, and each agent's rows sit next to each other in one block
+static void checkRows(SNMPManager &snmp)
+{
+    ValueCallback *previous[AGENTS] = {0};
+    for (int row = 0; row < ROWS; row++)
+    {
+        ValueCallback *callback = snmp.findCallback(rowIP(row), oids[row]);
+        CHECK(callback && callback->value == &values[row] && callback->type == INTEGER);
+        int agent = row % AGENTS;
+        CHECK(!previous[agent] || callback == previous[agent] + 1);
+        previous[agent] = callback;
+    }
+    for (int agent = 0; agent < AGENTS; agent++)
+    {
+        CHECK(snmp.findAgent(IPAddress(10, 0, agent, 1))->handlerCount() == ROWS / AGENTS);
+    }
+}
+
+int main()
+{
+    for (int row = 0; row < ROWS; row++)
+    {
+        snprintf(oids[row], sizeof(oids[row]), ".1.3.6.1.2.1.2.2.1.%d.%d", 10 + row % 4, row / 4 + 1);
+        table[row] = {{10, 0, (uint8_t)(row % AGENTS), 1}, oids[row], INTEGER, &values[row]};
+    }
+
+    SNMPManager snmp("public");
+    HostUDP udp;
+    snmp.setUDP(&udp);
+    auto start = std::chrono::steady_clock::now();
+    CHECK(snmp.addHandlers(table, ROWS) == ROWS);
+    ::printf("%d rows registered in %.1f us\n", ROWS, std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    checkRows(snmp);
+
+    // The OIDs are encoded into the handlers, so the table's strings aren't needed afterwards
+    char copied[32];
+    strcpy(copied, ".1.3.6.1.2.1.1.3.0");
+    const SNMPHandlerEntry extra[] = {
+        {{10, 0, 0, 9}, copied, TIMESTAMP, &uptime},
+        {{10, 0, 0, 9}, ".1.3.6.1.4.1.2021.10.1.5.1", INTEGER, &load, true},
+    };
+    CHECK(snmp.addHandlers(extra, 2) == 2);
+    memset(copied, 0, sizeof(copied));
+    udp.receive(IPAddress(10, 0, 0, 9), getResponse("public", 1, {{".1.3.6.1.2.1.1.3.0", new TimestampType(777)}, {".1.3.6.1.4.1.2021.10.1.5.1", new IntegerType(42)}}));
+    udp.receive(rowIP(3), getResponse("public", 2, {{oids[3], new IntegerType(5)}}));
+    snmp.loop();
+    snmp.loop();
+    CHECK(uptime == 777);
+    CHECK(load == 4.2f);
+    CHECK(values[3] == 5);
+
+    // The same table through the PROGMEM reads, on another manager
+    SNMPManager progmem("public");
+    progmem.setUDP(&udp);
+    CHECK(progmem.addHandlers_P(table, ROWS) == ROWS);
+    checkRows(progmem);
+
+    return testResult();
+}
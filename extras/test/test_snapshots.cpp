@@ -0,0 +1,118 @@
+// A reader thread copies handler values while loop() writes them, and must only ever see whole responses.
+//
+//     g++ -std=gnu++17 -pthread -I extras/test -I src extras/test/test_snapshots.cpp -o /tmp/test_snapshots && /tmp/test_snapshots
+
+#define SNMP_SNAPSHOTS
+#include "host.h"
+#include <atomic>
+
+#define VALUES 30 // 30 Counter64 values are more than SNMP_SNAPSHOT_STAGING holds
+#define RESPONSES 2000
+
+static uint64_t values[VALUES];
+static char oids[VALUES][32];
+static int responseValues = 0; // Values in each response of the current run
+static int changes = 0;
+static int partialChanges = 0;
+
+static void onChange(IPAddress ip, ValueCallback *callback)
+{
+    // Every value of the response has been written before any change callback
+    changes++;
+    for (int i = 1; i < responseValues; i++)
+    {
+        if (values[i] != values[0])
+        {
+            partialChanges++;
+            return;
+        }
+    }
+}
+
+// Polls responses carrying count values, each holding the response number in both halves, while another thread reads them
+static void pollWhileReading(SNMPManager &snmp, HostUDP &udp, IPAddress ip, int count)
+{
+    responseValues = count;
+    std::vector<std::vector<uint8_t>> responses;
+    for (uint64_t n = 1; n <= RESPONSES; n++)
+    {
+        std::vector<std::pair<const char *, BER_CONTAINER *>> varBinds;
+        for (int i = 0; i < count; i++)
+        {
+            varBinds.push_back({oids[i], new Counter64(n << 32 | n)});
+        }
+        responses.push_back(getResponse("public", n, varBinds));
+    }
+
+    std::atomic<bool> started(false), done(false);
+    long reads = 0, torn = 0, mixed = 0;
+    std::thread reader([&] {
+        while (!done)
+        {
+            uint64_t copy[VALUES];
+            uint32_t sequence;
+            do
+            {
+                sequence = snmp.readBegin();
+                memcpy(copy, values, sizeof(copy));
+            } while (snmp.readRetry(sequence));
+            reads++;
+            started = true;
+            for (int i = 0; i < count; i++)
+            {
+                if ((copy[i] >> 32) != (copy[i] & 0xFFFFFFFF))
+                {
+                    torn++;
+                }
+                if (copy[i] != copy[0])
+                {
+                    mixed++;
+                }
+            }
+        }
+    });
+    while (!started)
+    {
+        yield();
+    }
+    for (auto &response : responses)
+    {
+        udp.receive(ip, response);
+        snmp.loop();
+    }
+    done = true;
+    reader.join();
+
+    CHECK(reads > 0);
+    CHECK(torn == 0);
+    CHECK(mixed == 0);
+    CHECK(values[count - 1] == ((uint64_t)RESPONSES << 32 | RESPONSES));
+}
+
+int main()
+{
+    SNMPManager snmp("public");
+    HostUDP udp;
+    snmp.setUDP(&udp);
+    snmp.setChangeCallback(onChange);
+    IPAddress ip(10, 0, 0, 1);
+    for (int i = 0; i < VALUES; i++)
+    {
+        snprintf(oids[i], sizeof(oids[i]), ".1.3.6.1.2.1.31.1.1.1.6.%d", i + 1);
+        snmp.addCounter64Handler(ip, oids[i], &values[i]);
+    }
+
+    // Two values fit in the stage and are written together
+    pollWhileReading(snmp, udp, ip, 2);
+    CHECK(changes == 2 * RESPONSES);
+    CHECK(partialChanges == 0);
+
+    // The stage overflows, the response is then held under one write section until it has been decoded
+    memset(values, 0, sizeof(values));
+    changes = 0;
+    pollWhileReading(snmp, udp, ip, VALUES);
+    CHECK(changes == VALUES * RESPONSES);
+    CHECK(partialChanges == 0);
+
+    return testResult();
+}
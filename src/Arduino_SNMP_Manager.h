@@ -15,95 +15,89 @@
 #endif
 #endif
 
-#define MIN(X, Y) ((X < Y) ? X : Y)
-
-#include <Udp.h>
+#ifndef SNMP_MAX_REQUEST_SOCKETS
+#define SNMP_MAX_REQUEST_SOCKETS 4 // Maximum number of request/response sockets which can be added to the manager.
+#endif
 
-#include "BER.h"
-#include "VarBinds.h"
+#ifndef SNMP_EPHEMERAL_PORT_BASE
+#define SNMP_EPHEMERAL_PORT_BASE 49152 // Start of the IANA dynamic port range, used for request sockets.
+#endif
 
-class ValueCallback
-{
-public:
-    ValueCallback(ASN_TYPE atype) : type(atype){};
-    IPAddress ip;
-    char *OID;
-    ASN_TYPE type;
-    bool overwritePrefix = false;
-};
+#ifndef SNMP_MAX_PENDING_REQUESTS
+#define SNMP_MAX_PENDING_REQUESTS 16 // Maximum number of tracked requests awaiting a response at any one time.
+#endif
 
-class IntegerCallback : public ValueCallback
-{
-public:
-    IntegerCallback() : ValueCallback(INTEGER){};
-    int *value;
-    bool isFloat = false;
-};
+#ifndef SNMP_REQUEST_TIMEOUT
+#define SNMP_REQUEST_TIMEOUT 5000 // Milliseconds before a tracked request is reported as timed out.
+#endif
 
-class TimestampCallback : public ValueCallback
-{
-public:
-    TimestampCallback() : ValueCallback(TIMESTAMP){};
-    uint32_t *value;
-};
+#ifndef SNMP_RECEIVE_CHUNK_LENGTH
+#define SNMP_RECEIVE_CHUNK_LENGTH 64 // Bytes read from the socket at a time when decoding a response, at least 8.
+#endif
 
-class StringCallback : public ValueCallback
-{
-public:
-    StringCallback() : ValueCallback(STRING){};
-    char **value;
-};
+#define SNMP_ERROR_TIMEOUT -1   // errorStatus reported to a request owner when no response arrived in time
+#define SNMP_ERROR_TOO_BIG 1    // errorStatus of a response that wouldn't fit in the agent's largest message
+#define SNMP_ERROR_CANCELLED -2 // errorStatus reported to a request owner when its request was cancelled, e.g. its agent removed
 
-class OIDCallback : public ValueCallback
-{
-public:
-    OIDCallback() : ValueCallback(ASN_TYPE::OID){};
-    char *value;
-};
+#define MIN(X, Y) ((X < Y) ? X : Y)
 
-class Counter32Callback : public ValueCallback
-{
-public:
-    Counter32Callback() : ValueCallback(ASN_TYPE::COUNTER32){};
-    uint32_t *value;
-};
+#include <Udp.h>
 
-class Gauge32Callback : public ValueCallback
-{
-public:
-    Gauge32Callback() : ValueCallback(ASN_TYPE::GAUGE32){};
-    uint32_t *value;
-};
+#include "BER.h"
+#include "VarBinds.h"
+#include "SNMPv3.h"
+#include "SNMPAgent.h"
+#include "SNMPSnapshot.h"
+#include "SNMPHistory.h"
+#include "SNMPAlarms.h"
+#include "SNMPBufferPool.h"
 
-class Counter64Callback : public ValueCallback
+class SNMPRequestOwner
 {
 public:
-    Counter64Callback() : ValueCallback(ASN_TYPE::COUNTER64){};
-    uint64_t *value;
+    virtual ~SNMPRequestOwner(){};
+    // Return true if the response has been handled and its varbinds should not be passed to the value handlers.
+    virtual bool onResponse(IPAddress ip, unsigned long requestID, int errorStatus, int errorIndex, uint8_t tag) = 0;
+    virtual void onTimeout(IPAddress ip, unsigned long requestID, uint8_t tag) = 0;
+    // Offered each varbind of a response not handled by onResponse. Return true if handled, false to pass it to the value handlers.
+    virtual bool onResponseVarBind(IPAddress ip, const unsigned char *oid, uint8_t oidLength, BER_CONTAINER *value, uint8_t tag)
+    {
+        return false;
+    }
+    // Called once all the varbinds of a response not handled by onResponse have been decoded.
+    virtual void onResponseComplete(IPAddress ip, uint8_t tag){};
+    // Called instead of onResponseComplete when the response turned out truncated or malformed, so its varbinds may not all have
+    // been decoded. Handled as a timeout unless overridden.
+    virtual void onResponseFailed(IPAddress ip, unsigned long requestID, uint8_t tag)
+    {
+        onTimeout(ip, requestID, tag);
+    }
+    // Called when the manager cancels a tracked request, as when its agent is removed. Nothing should be sent to the address from
+    // here. Handled as a timeout unless overridden.
+    virtual void onCancelled(IPAddress ip, unsigned long requestID, uint8_t tag)
+    {
+        onTimeout(ip, requestID, tag);
+    }
 };
 
-typedef struct ValueCallbackList
+typedef struct PendingRequestStruct
 {
-    ~ValueCallbackList()
-    {
-        delete next;
-    }
-    ValueCallback *value;
-    struct ValueCallbackList *next = 0;
-} ValueCallbacks;
+    unsigned long requestID;
+    IPAddress ip;
+    unsigned long sentAt;
+    SNMPRequestOwner *owner = 0; // Slot is free when owner is null
+    uint8_t tag;                 // Owner defined, e.g. which batch of a split request
+} PendingRequest;
 
-#include "SNMPGet.h"
-#include "SNMPGetResponse.h"
+#include "SNMPResponseDecoder.h"
 
-class SNMPManager
+class SNMPManager : public SNMPResponseHandler
 {
 public:
     SNMPManager(){};
     SNMPManager(const char *community) : _community(community){};
-    const char *_community;
+    const char *_community = 0;
 
-    ValueCallbacks *callbacks = new ValueCallbacks();
-    ValueCallbacks *callbacksCursor = callbacks;
     ValueCallback *findCallback(IPAddress ip, const char *oid); // Find based on responding host IP address and OID
     ValueCallback *addFloatHandler(IPAddress ip, const char *oid, float *value);
     ValueCallback *addStringHandler(IPAddress ip, const char *, char **); // passing in a pointer to a char*
@@ -113,20 +107,105 @@ public:
     ValueCallback *addCounter64Handler(IPAddress ip, const char *oid, uint64_t *value);
     ValueCallback *addCounter32Handler(IPAddress ip, const char *oid, uint32_t *value);
     ValueCallback *addGaugeHandler(IPAddress ip, const char *oid, uint32_t *value);
+    ValueCallback *addPrefixHandler(IPAddress ip, const char *oid, PrefixValueCallback callback); // Every OID below oid
+    int addHandlers(const SNMPHandlerEntry *table, int count);   // Returns the number of handlers registered
+    int addHandlers_P(const SNMPHandlerEntry *table, int count); // Table and its OID strings in PROGMEM
+    void setChangeCallback(ValueChangeCallback callback); // Called when a handler's value changes, unless the handler has its own
+    void setAlarms(SNMPAlarms *alarms);                   // Tests the alarm conditions on each value received
+    unsigned int changedValues(); // Handler values changed so far by the response being parsed
+    unsigned int responseLength(); // Length of the response being parsed
+    uint32_t generation();         // Goes up by one for each response that changes any handler value
+    // Calls the callback for each handler whose value changed after the generation given, returning how many. Handlers are found
+    // through a dirty bitmap per agent, so the work follows the number of changes rather than the number of handlers.
+    int forEachChanged(uint32_t since, ValueChangeCallback callback);
+    // For reading handler values from another core or task: copy them out after readBegin() and again if readRetry() is true.
+    // With SNMP_SNAPSHOTS defined the values of a whole response are written together, otherwise each value is. readBegin() waits,
+    // yielding, while values are being written, so it must not be called from an interrupt handler.
+    uint32_t readBegin();
+    bool readRetry(uint32_t sequence);
 
     void setUDP(UDP *udp);
+    bool addRequestUDP(UDP *udp, uint16_t localPort = 0);
+    UDP *requestUDP();
     bool begin();
     bool loop();
     bool testParsePacket(String testPacket);
-    char OIDBuf[MAX_OID_LENGTH];
-    UDP *_udp;
-    void addHandler(ValueCallback *callback);
+    UDP *_udp = 0; // Listener socket bound to port 162, used for traps (and responses when no request socket is added)
+    bool trackRequest(IPAddress ip, unsigned long requestID, SNMPRequestOwner *owner, uint8_t tag = 0);
+    // Responses with request IDs from firstRequestID to firstRequestID + count - 1, from any address, go to the owner until cancelled.
+    // For sending to many agents at once without tracking each request. There is one range, so returns false while another
+    // owner holds it.
+    bool trackRequestRange(unsigned long firstRequestID, unsigned long count, SNMPRequestOwner *owner);
+    void cancelRequests(SNMPRequestOwner *owner);
+    void cancelRequest(IPAddress ip, unsigned long requestID); // Stops tracking one request, e.g. one that could not be sent
+    // Whether a request to the agent could be tracked, would be within its window and the send rate limit, and it isn't down
+    // between probes
+    bool canSend(IPAddress ip);
+    void setAgentStateCallback(AgentStateCallback callback); // Called when an agent goes up, suspect or down
+    // Limits tracked requests to perSecond, in bursts of up to burst. 0 for no limit.
+    void setRateLimit(unsigned int perSecond, uint8_t burst = 8);
+    void cancelRequests(IPAddress ip); // Stops tracking the requests to the address, telling each owner through onCancelled()
+    bool removeHandler(ValueCallback *callback); // Stops the value being updated, any request still holding it skips it
+    bool removeAgent(IPAddress ip);              // Removes the agent and its handlers, cancelling its requests in flight
+    void releaseHandlerMemory(); // Once nothing holds a removed handler, lets their slots be reused and frees removed agents' handlers
+    SNMPAgent *addAgent(IPAddress ip, const char *community, short version, uint16_t port = 161);
+    SNMPAgent *addAgent(IPAddress ip, SNMPv3Engine *engine, uint16_t port = 161);
+    SNMPAgent *findAgent(IPAddress ip);
+    void addEngine(SNMPv3Engine *engine);
+    SNMPv3Engine *findEngine(IPAddress ip);
+    bool onHeader(int version, const char *community, ASN_TYPE pduType, unsigned long requestID, int errorStatus, int errorIndex);
+    bool onVarBind(const unsigned char *oid, uint8_t oidLength, BER_CONTAINER *value);
 
 private:
-    unsigned char _packetBuffer[SNMP_PACKET_LENGTH * 3];
-    bool inline receivePacket(int length);
-    bool parsePacket();
-    void printPacket(int len);
+    SNMPResponseDecoder _decoder{this};
+    SNMPAgent *_agent = 0; // Agent the packet currently being parsed came from, if registered
+    SNMPRequestOwner *_responseOwner = 0; // Owner of the tracked request the packet being parsed answers, offered its varbinds
+    unsigned long _responseRequestID;
+    uint8_t _responseTag;
+    unsigned int _changedValues = 0; // Handler values changed by the response being parsed
+    uint32_t _generation = 0;
+    unsigned int _responseLength = 0;
+    bool _parsed = false;
+    UDP *_requestUdp[SNMP_MAX_REQUEST_SOCKETS];
+    uint8_t _requestUdpCount = 0;
+    uint8_t _requestUdpNext = 0;
+    IPAddress _remoteIP; // Source address of the packet currently being parsed
+    SNMPAgentTable _agents;
+    ValueChangeCallback _changeCallback = 0;
+    SNMPAlarms *_alarms = 0;
+    AgentStateCallback _agentStateCallback = 0;
+    SNMPSeqLock _seqLock;
+#ifdef SNMP_SNAPSHOTS
+    SNMPValueStage _stage; // Values of the response being parsed, written to their handlers once it has been
+    bool _writing = false; // The stage overflowed, so the rest of the response is being written inside one write section
+    void commitValues();
+#endif
+    PendingRequest _pendingRequests[SNMP_MAX_PENDING_REQUESTS];
+    unsigned int _rate = 0;
+    uint8_t _burst;
+    long _tokens;        // Thousandths of a request, negative when requests were tracked beyond the limit
+    unsigned long _refilledAt;
+    SNMPRequestOwner *_rangeOwner = 0;
+    unsigned long _rangeFirstID;
+    unsigned long _rangeCount;
+    PendingRequest *findPendingRequest(IPAddress ip, unsigned long requestID);
+    void expirePendingRequests();
+    SNMPAgent *endRequest(PendingRequest *pending);
+    void refillTokens();
+    bool inline receivePacket(UDP *udp, int length);
+    bool parsePacket(unsigned char *packet, int length);
+    bool decodeResult();
+    bool validCommunity(int version, const char *community);
+    void printPacket(const unsigned char *buf, int len);
+    void printOID(const unsigned char *oid, uint8_t oidLength);
+    ValueCallback *addHandler(IPAddress ip, const char *oid, ASN_TYPE type, void *value);
+    int addHandlers(const SNMPHandlerEntry *table, int count, bool progmem);
+    bool storeValue(ValueCallback *callback, BER_CONTAINER *value);
+    bool writeValue(ValueCallback *callback, const void *value, uint16_t size);
+    void recordHistory(ValueCallback *callback, BER_CONTAINER *value);
+    bool numericValue(ValueCallback *callback, BER_CONTAINER *value, float *number);
+    bool pastDeadband(ValueCallback *callback, float difference, float stored);
+    static uint32_t stringHash(const char *value, size_t length);
 };
 
 void SNMPManager::setUDP(UDP *udp)
@@ -139,6 +218,41 @@ void SNMPManager::setUDP(UDP *udp)
     this->begin();
 }
 
+bool SNMPManager::addRequestUDP(UDP *udp, uint16_t localPort)
+{
+    // Request sockets carry GetRequests and their responses, keeping them off the trap listener's receive queue.
+    if (!udp || _requestUdpCount >= SNMP_MAX_REQUEST_SOCKETS)
+    {
+        return false;
+    }
+    if (localPort == 0)
+    {
+        localPort = SNMP_EPHEMERAL_PORT_BASE + random(65536 - SNMP_EPHEMERAL_PORT_BASE);
+    }
+    if (!udp->begin(localPort))
+    {
+        return false;
+    }
+#ifdef DEBUG
+    Serial.print(F("[DEBUG] Request socket bound to port: "));
+    Serial.println(localPort);
+#endif
+    _requestUdp[_requestUdpCount++] = udp;
+    return true;
+}
+
+UDP *SNMPManager::requestUDP()
+{
+    // Hand out the request sockets in turn, falling back to the listener if none have been added.
+    if (!_requestUdpCount)
+    {
+        return _udp;
+    }
+    UDP *udp = _requestUdp[_requestUdpNext];
+    _requestUdpNext = (_requestUdpNext + 1) % _requestUdpCount;
+    return udp;
+}
+
 bool SNMPManager::begin()
 {
     if (!_udp)
@@ -149,20 +263,222 @@ bool SNMPManager::begin()
 
 bool SNMPManager::loop()
 {
-    if (!_udp)
+    if (!_udp && !_requestUdpCount)
+    {
+        return false;
+    }
+    // Service each socket once per call so a burst of responses can't starve the trap listener, or vice versa.
+    for (uint8_t i = 0; i < _requestUdpCount; i++)
+    {
+        receivePacket(_requestUdp[i], _requestUdp[i]->parsePacket());
+    }
+    if (_udp)
+    {
+        receivePacket(_udp, _udp->parsePacket());
+    }
+    expirePendingRequests();
+    return true;
+}
+
+bool SNMPManager::trackRequest(IPAddress ip, unsigned long requestID, SNMPRequestOwner *owner, uint8_t tag)
+{
+    for (int i = 0; i < SNMP_MAX_PENDING_REQUESTS; i++)
+    {
+        if (!_pendingRequests[i].owner)
+        {
+            _pendingRequests[i].requestID = requestID;
+            _pendingRequests[i].ip = ip;
+            _pendingRequests[i].sentAt = millis();
+            _pendingRequests[i].owner = owner;
+            _pendingRequests[i].tag = tag;
+            SNMPAgent *agent = _agents.find(ip);
+            if (agent)
+            {
+                agent->inFlight++;
+            }
+            if (_rate)
+            {
+                refillTokens();
+                _tokens -= 1000;
+            }
+            return true;
+        }
+    }
+#ifdef DEBUG
+    Serial.println(F("[DEBUG] Pending request table full"));
+#endif
+    return false;
+}
+
+bool SNMPManager::trackRequestRange(unsigned long firstRequestID, unsigned long count, SNMPRequestOwner *owner)
+{
+    if (_rangeOwner && _rangeOwner != owner)
     {
         return false;
     }
-    receivePacket(_udp->parsePacket());
+    _rangeOwner = owner;
+    _rangeFirstID = firstRequestID;
+    _rangeCount = count;
     return true;
 }
 
-void SNMPManager::printPacket(int len)
+void SNMPManager::cancelRequests(SNMPRequestOwner *owner)
+{
+    if (_rangeOwner == owner)
+    {
+        _rangeOwner = 0;
+    }
+    for (int i = 0; i < SNMP_MAX_PENDING_REQUESTS; i++)
+    {
+        if (_pendingRequests[i].owner == owner)
+        {
+            endRequest(&_pendingRequests[i]);
+        }
+    }
+}
+
+void SNMPManager::cancelRequest(IPAddress ip, unsigned long requestID)
+{
+    PendingRequest *pending = findPendingRequest(ip, requestID);
+    if (pending)
+    {
+        endRequest(pending);
+    }
+}
+
+void SNMPManager::cancelRequests(IPAddress ip)
+{
+    // The requests are picked out first, so one an owner tracks from onCancelled() isn't cancelled too
+    bool cancel[SNMP_MAX_PENDING_REQUESTS];
+    for (int i = 0; i < SNMP_MAX_PENDING_REQUESTS; i++)
+    {
+        cancel[i] = _pendingRequests[i].owner && _pendingRequests[i].ip == ip;
+    }
+    for (int i = 0; i < SNMP_MAX_PENDING_REQUESTS; i++)
+    {
+        PendingRequest *pending = &_pendingRequests[i];
+        if (cancel[i] && pending->owner && pending->ip == ip)
+        {
+            // Freed before notifying, as for a timeout
+            SNMPRequestOwner *owner = pending->owner;
+            endRequest(pending);
+            owner->onCancelled(pending->ip, pending->requestID, pending->tag);
+        }
+    }
+}
+
+PendingRequest *SNMPManager::findPendingRequest(IPAddress ip, unsigned long requestID)
+{
+    for (int i = 0; i < SNMP_MAX_PENDING_REQUESTS; i++)
+    {
+        if (_pendingRequests[i].owner && _pendingRequests[i].requestID == requestID && _pendingRequests[i].ip == ip)
+        {
+            return &_pendingRequests[i];
+        }
+    }
+    return 0;
+}
+
+SNMPAgent *SNMPManager::endRequest(PendingRequest *pending)
+{
+    pending->owner = 0;
+    SNMPAgent *agent = _agents.find(pending->ip);
+    if (agent && agent->inFlight)
+    {
+        agent->inFlight--;
+    }
+    return agent;
+}
+
+bool SNMPManager::canSend(IPAddress ip)
+{
+    bool tableFull = true;
+    for (int i = 0; i < SNMP_MAX_PENDING_REQUESTS && tableFull; i++)
+    {
+        tableFull = _pendingRequests[i].owner != 0;
+    }
+    if (tableFull)
+    {
+        return false;
+    }
+    if (_rate)
+    {
+        refillTokens();
+        if (_tokens < 1000)
+        {
+            return false;
+        }
+    }
+    SNMPAgent *agent = _agents.find(ip);
+    return !agent || agent->canSend();
+}
+
+void SNMPManager::setAlarms(SNMPAlarms *alarms)
+{
+    _alarms = alarms;
+}
+
+void SNMPManager::setAgentStateCallback(AgentStateCallback callback)
+{
+    _agentStateCallback = callback;
+}
+
+void SNMPManager::setRateLimit(unsigned int perSecond, uint8_t burst)
+{
+    _rate = perSecond;
+    _burst = burst;
+    _tokens = burst * 1000L;
+    _refilledAt = millis();
+}
+
+void SNMPManager::refillTokens()
+{
+    unsigned long now = millis();
+    unsigned long elapsed = now - _refilledAt;
+    if (elapsed > 1000UL * _burst)
+    {
+        elapsed = 1000UL * _burst; // Enough to fill the bucket, and can't overflow
+    }
+    _tokens += (long)(elapsed * _rate);
+    if (_tokens > _burst * 1000L)
+    {
+        _tokens = _burst * 1000L;
+    }
+    _refilledAt = now;
+}
+
+void SNMPManager::expirePendingRequests()
+{
+    unsigned long now = millis();
+    for (int i = 0; i < SNMP_MAX_PENDING_REQUESTS; i++)
+    {
+        PendingRequest *pending = &_pendingRequests[i];
+        if (pending->owner && now - pending->sentAt >= SNMP_REQUEST_TIMEOUT)
+        {
+            // Free the slot before notifying, so the owner can resend from within the callback
+            SNMPRequestOwner *owner = pending->owner;
+            SNMPAgent *agent = endRequest(pending);
+            if (agent && agent->requestTimedOut() && _agentStateCallback)
+            {
+                _agentStateCallback(agent->ip, agent->state);
+            }
+            owner->onTimeout(pending->ip, pending->requestID, pending->tag);
+        }
+    }
+}
+
+void SNMPManager::printOID(const unsigned char *oid, uint8_t oidLength)
+{
+    char dotted[MAX_OID_LENGTH];
+    Serial.print(berDecodeOID(oid, oidLength, dotted, MAX_OID_LENGTH) >= 0 ? dotted : "(too long)");
+}
+
+void SNMPManager::printPacket(const unsigned char *buf, int len)
 {
     Serial.print("[DEBUG] packet: ");
     for (int i = 0; i < len; i++)
     {
-        Serial.printf("%02x ", _packetBuffer[i]);
+        Serial.printf("%02x ", buf[i]);
     }
     Serial.println();
 }
@@ -172,382 +488,818 @@ bool SNMPManager::testParsePacket(String testPacket)
     // Function to test sample packet, each byte to be separated with a space:
     // e.g. "32 02 01 01 04 06 70 75 62 6c 69 63 a2 25 02 02 0c 01 02 01 00 02 c1 00 30 19 30 17 06 11 2b 06 01 04 01 81 9e 16 02 03 01 01 01 02 03 01 00 02 02 14 9f";
     int len = testPacket.length() + 1;
-    memset(_packetBuffer, 0, SNMP_PACKET_LENGTH * 3);
+    SNMPBuffer buffer(len / 3 + 1); // Each byte takes at least 3 characters, two digits and a space
+    if (!buffer.data)
+    {
+        return false;
+    }
     char charArrayPacket[len];
     testPacket.toCharArray(charArrayPacket, len);
     // split charArray at each ' ' and convert to uint8_t
     char *p = strtok(charArrayPacket, " ");
     int i = 0;
-    while (p != NULL)
+    while (p != NULL && i < (int)buffer.size)
     {
-        _packetBuffer[i++] = strtoul(p, NULL, 16);
+        buffer.data[i++] = strtoul(p, NULL, 16);
         p = strtok(NULL, " ");
     }
-    _packetBuffer[i] = 0; // null terminate the buffer
 #ifdef DEBUG
-    printPacket(len);
+    printPacket(buffer.data, i);
 #endif
 
-    return parsePacket();
+    return parsePacket(buffer.data, i);
 }
 
-bool inline SNMPManager::receivePacket(int packetLength)
+bool inline SNMPManager::receivePacket(UDP *udp, int packetLength)
 {
     if (!packetLength)
     {
         return false;
     }
+    _remoteIP = udp->remoteIP();
+    _responseLength = packetLength;
 #ifdef DEBUG
     Serial.print(F("[DEBUG] Packet Length: "));
     Serial.print(packetLength);
     Serial.print(F(" From Address: "));
-    Serial.println(_udp->remoteIP());
+    Serial.println(_remoteIP);
 #endif
 
-    memset(_packetBuffer, 0, SNMP_PACKET_LENGTH * 3);
-    int len = packetLength;
-    _udp->read(_packetBuffer, MIN(len, SNMP_PACKET_LENGTH));
-    _udp->flush();
-    _packetBuffer[len] = 0; // null terminate the buffer
+    unsigned char chunk[SNMP_RECEIVE_CHUNK_LENGTH];
+    int length = udp->read(chunk, SNMP_RECEIVE_CHUNK_LENGTH);
+    if (snmpIsV3Message(chunk, length))
+    {
+        // SNMPv3 messages are authenticated as a whole, so are the only ones which have to be held in full
+        if (packetLength > SNMP_PACKET_LENGTH)
+        {
+            Serial.print(F("SNMPv3 message too long: "));
+            Serial.println(packetLength);
+            udp->flush();
+            return false;
+        }
+        SNMPBuffer buffer(packetLength);
+        if (!buffer.data)
+        {
+            udp->flush();
+            return false;
+        }
+        memcpy(buffer.data, chunk, length);
+        length += udp->read(buffer.data + length, packetLength - length);
+        udp->flush();
+#ifdef DEBUG
+        printPacket(buffer.data, length);
+#endif
+        return parsePacket(buffer.data, length);
+    }
 
+    // Hand the datagram to the decoder a chunk at a time, varbinds are dispatched as each one completes
+    _agent = _agents.find(_remoteIP);
+    _responseOwner = 0;
+    _changedValues = 0;
+    _parsed = true;
+    _decoder.begin();
+    while (length > 0)
+    {
 #ifdef DEBUG
-    printPacket(len);
+        printPacket(chunk, length);
 #endif
+        if (!_decoder.decode(chunk, length))
+        {
+            break;
+        }
+        length = udp->read(chunk, SNMP_RECEIVE_CHUNK_LENGTH);
+    }
+    udp->flush(); // Discard whatever the decoder didn't need
+    return decodeResult();
+}
+
+SNMPAgent *SNMPManager::addAgent(IPAddress ip, const char *community, short version, uint16_t port)
+{
+    SNMPAgent *agent = _agents.add(ip);
+    agent->community = community;
+    agent->version = version;
+    agent->port = port;
+    agent->engine = 0;
+    return agent;
+}
+
+SNMPAgent *SNMPManager::addAgent(IPAddress ip, SNMPv3Engine *engine, uint16_t port)
+{
+    SNMPAgent *agent = _agents.add(ip);
+    agent->community = 0;
+    agent->version = SNMP_VERSION_3;
+    agent->port = port;
+    agent->engine = engine;
+    return agent;
+}
+
+bool SNMPManager::removeHandler(ValueCallback *callback)
+{
+    if (!callback || !callback->agent)
+    {
+        return false;
+    }
+    callback->agent->removeHandler(callback);
+#ifdef SNMP_SNAPSHOTS
+    _stage.dropRemoved(); // A value staged for the handler must not be written once its slot is reused
+#endif
+    return true;
+}
+
+bool SNMPManager::removeAgent(IPAddress ip)
+{
+    cancelRequests(ip);
+    if (_agent && _agent->ip == ip)
+    {
+        _agent = 0; // Removed by a handler while its response is being decoded
+    }
+    bool removed = _agents.remove(ip);
+#ifdef SNMP_SNAPSHOTS
+    _stage.dropRemoved();
+#endif
+    return removed;
+}
+
+void SNMPManager::releaseHandlerMemory()
+{
+    // Removed handlers are kept in case a request still points at them, this reuses their slots and returns the handler blocks
+    // of removed agents to the heap
+#ifdef SNMP_SNAPSHOTS
+    _stage.dropRemoved();
+#endif
+    _agents.reclaimRemoved();
+    SNMPHandlerPool::freeSpare();
+}
+
+SNMPAgent *SNMPManager::findAgent(IPAddress ip)
+{
+    return _agents.find(ip);
+}
 
-    return parsePacket();
+void SNMPManager::addEngine(SNMPv3Engine *engine)
+{
+    addAgent(engine->ip, engine);
+}
+
+SNMPv3Engine *SNMPManager::findEngine(IPAddress ip)
+{
+    SNMPAgent *agent = _agents.find(ip);
+    return agent ? agent->engine : 0;
 }
 
-bool SNMPManager::parsePacket()
+bool SNMPManager::validCommunity(int version, const char *community)
 {
-    SNMPGetResponse *snmpgetresponse = new SNMPGetResponse();
-    if (snmpgetresponse->parseFrom(_packetBuffer))
+    // The response version is one more than the version field on the wire, so v1 = 1 and v2c = 2.
+    if (_agent && _agent->version != SNMP_VERSION_UNSET)
     {
-        if (snmpgetresponse->requestType == GetResponsePDU)
+        const char *expected = _agent->community ? _agent->community : _community;
+        return !_agent->engine && version == _agent->version + 1 && expected && strcmp(expected, community) == 0;
+    }
+    const char *expected = (_agent && _agent->community) ? _agent->community : _community;
+    return (version == 1 || version == 2) && expected && strcmp(expected, community) == 0;
+}
+
+bool SNMPManager::parsePacket(unsigned char *packet, int length)
+{
+    // Decode a message held in full
+    _agent = _agents.find(_remoteIP);
+    _responseLength = length;
+    _responseOwner = 0;
+    _changedValues = 0;
+    _parsed = true;
+    if (snmpIsV3Message(packet, length))
+    {
+        SNMPv3Engine *engine = _agent ? _agent->engine : 0;
+        if (!engine)
         {
-            if (!(snmpgetresponse->version != 1 || snmpgetresponse->version != 2) || strcmp(_community, snmpgetresponse->communityString) != 0)
-            {
-                Serial.print(F("Invalid community or version - Community: "));
-                Serial.print(snmpgetresponse->communityString);
-                Serial.print(F(" - Version: "));
-                Serial.println(snmpgetresponse->version);
-                delete snmpgetresponse;
-                return false;
-            }
-#ifdef DEBUG
-            Serial.print(F("[DEBUG] Community: "));
-            Serial.println(snmpgetresponse->communityString);
-            Serial.print(F("[DEBUG] SNMP Version: "));
-            Serial.println(snmpgetresponse->version);
-#endif
-            int varBindIndex = 1;
-            snmpgetresponse->varBindsCursor = snmpgetresponse->varBinds;
-            while (true)
-            {
-                char *responseOID = snmpgetresponse->varBindsCursor->value->oid->_value;
-                IPAddress responseIP = _udp->remoteIP();
-                ASN_TYPE responseType = snmpgetresponse->varBindsCursor->value->type;
-                BER_CONTAINER *responseContainer = snmpgetresponse->varBindsCursor->value->value;
-#ifdef DEBUG
-                Serial.print(F("[DEBUG] Response from: "));
-                Serial.print(responseIP);
-                Serial.print(F(" - OID: "));
-                Serial.println(responseOID);
-#endif
-                ValueCallback *callback = findCallback(responseIP, responseOID);
-                if (!callback)
-                {
-                    Serial.print(F("Matching callback not found for received SNMP response. Response OID: "));
-                    Serial.print(responseOID);
-                    Serial.print(F(" - From IP Address: "));
-                    Serial.println(responseIP);
-                    delete snmpgetresponse;
-                    return false;
-                }
-                ASN_TYPE callbackType = callback->type;
-                if (callbackType != responseType)
-                {
-                    switch (responseType)
-                    {
-                    case NOSUCHOBJECT:
-                    {
-                        Serial.print(F("No such object: "));
-                    }
-                    break;
-                    case NOSUCHINSTANCE:
-                    {
-                        Serial.print(F("No such instance: "));
-                    }
-                    break;
-                    case ENDOFMIBVIEW:
-                    {
-                        Serial.print(F("End of MIB view when calling: "));
-                    }
-                    break;
-                    default:
-                    {
-                        Serial.print(F("Incorrect Callback type. Expected: "));
-                        Serial.print(callbackType);
-                        Serial.print(F(" Received: "));
-                        Serial.print(responseType);
-                        Serial.print(F(" - When calling: "));
-                    }
-                    }
-                    Serial.println(responseOID);
-                    delete snmpgetresponse;
-                    snmpgetresponse = 0;
-                    return false;
-                }
-                switch (callbackType)
-                {
-                case STRING:
-                {
-#ifdef DEBUG
-                    Serial.println("[DEBUG] Type: String");
-#endif
-
-                    // Note: Requires that the size of the variable used to store the response is big enough.
-                    // Otherwise move responsibility for the creation of the variable to store the value here, but this would put the onus on the caller to free and reset to null.
-                    //*((StringCallback *)callback)->value = (char *)malloc(64); // Allocate memory for string, caller will need to free. Malloc updated to incoming message size.
-                    strncpy(*((StringCallback *)callback)->value, ((OctetType *)responseContainer)->_value, strlen(((OctetType *)responseContainer)->_value));
-                    OctetType *value = new OctetType(*((StringCallback *)callback)->value);
-                    delete value;
-                }
-                break;
-                case INTEGER:
-                {
-#ifdef DEBUG
-                    Serial.println("[DEBUG] Type: Integer");
-#endif
-                    IntegerType *value = new IntegerType();
-                    if (!((IntegerCallback *)callback)->isFloat)
-                    {
-                        *(((IntegerCallback *)callback)->value) = ((IntegerType *)responseContainer)->_value;
-                        value->_value = *(((IntegerCallback *)callback)->value);
-                    }
-                    else
-                    {
-                        *(((IntegerCallback *)callback)->value) = (float)(((IntegerType *)responseContainer)->_value / 10);
-                        value->_value = *(float *)(((IntegerCallback *)callback)->value) * 10;
-                    }
-                    delete value;
-                }
-                break;
-                case COUNTER32:
-                {
-#ifdef DEBUG
-                    Serial.println("[DEBUG] Type: Counter32");
-#endif
-                    Counter32 *value = new Counter32();
-                    *(((Counter32Callback *)callback)->value) = ((Counter32 *)responseContainer)->_value;
-                    value->_value = *(((Counter32Callback *)callback)->value);
-                    delete value;
-                }
-                break;
-                case COUNTER64:
-                {
-#ifdef DEBUG
-                    Serial.println("[DEBUG] Type: Counter64");
-#endif
-                    Counter64 *value = new Counter64();
-                    *(((Counter64Callback *)callback)->value) = ((Counter64 *)responseContainer)->_value;
-                    value->_value = *(((Counter64Callback *)callback)->value);
-                    delete value;
-                }
-                break;
-                case GAUGE32:
-                {
-#ifdef DEBUG
-                    Serial.println("[DEBUG] Type: Gauge32");
-#endif
-                    Gauge *value = new Gauge();
-                    *(((Gauge32Callback *)callback)->value) = ((Gauge *)responseContainer)->_value;
-                    value->_value = *(((Gauge32Callback *)callback)->value);
-                    delete value;
-                }
-                break;
-                case TIMESTAMP:
-                {
-#ifdef DEBUG
-                    Serial.println("[DEBUG] Type: TimeStamp");
-#endif
-                    TimestampType *value = new TimestampType();
-                    *(((TimestampCallback *)callback)->value) = ((TimestampType *)responseContainer)->_value;
-                    value->_value = *(((TimestampCallback *)callback)->value);
-                    delete value;
-                }
-                break;
-                default:
-                {
-#ifdef DEBUG
-                    Serial.print(F("[DEBUG] Unsupported Type: "));
-                    Serial.print(callbackType);
-#endif
-                }
-                break;
-                }
-                snmpgetresponse->varBindsCursor = snmpgetresponse->varBindsCursor->next;
-                if (!snmpgetresponse->varBindsCursor->value)
-                {
-                    break;
-                }
-                varBindIndex++;
-            } // End while
-        }     // End if GetResponsePDU
+            Serial.print(F("SNMPv3 response from unknown engine: "));
+            Serial.println(_remoteIP);
+            return false;
+        }
+        unsigned char *pdu = 0;
+        int pduLength = engine->unwrap(packet, length, &pdu);
+        if (pduLength <= 0)
+        {
+            return pduLength == 0; // Reports are consumed by the engine
+        }
+        _decoder.beginPDU(SNMP_VERSION_3 + 1);
+        _decoder.decode(pdu, pduLength);
     }
     else
     {
+        _decoder.begin();
+        _decoder.decode(packet, length);
+    }
+    return decodeResult();
+}
+
+bool SNMPManager::decodeResult()
+{
+    _decoder.end();
+#ifdef SNMP_SNAPSHOTS
+    commitValues();
+#endif
+    if (_responseOwner)
+    {
+        // Cleared first, as the owner will often send its next request from here
+        SNMPRequestOwner *owner = _responseOwner;
+        _responseOwner = 0;
+        if (_decoder.state() == DECODING || _decoder.state() == DECODE_FAILED)
+        {
+            owner->onResponseFailed(_remoteIP, _responseRequestID, _responseTag);
+        }
+        else
+        {
+            owner->onResponseComplete(_remoteIP, _responseTag);
+        }
+    }
+    switch (_decoder.state())
+    {
+    case DECODING:
+#ifndef SUPPRESS_ERROR_SHORT_PACKET
+        Serial.println(F("SNMP packet too short, ended before the last varbind."));
+#endif
+        return false;
+    case DECODE_FAILED:
 #ifndef SUPPRESS_ERROR_FAILED_PARSE
         Serial.println(F("SNMPGETRESPONSE: FAILED TO PARSE"));
 #endif
-        delete snmpgetresponse;
         return false;
+    default:
+        break;
     }
 #ifdef DEBUG
-    Serial.println(F("[DEBUG] SNMPGETRESPONSE: SUCCESS"));
+    if (_parsed)
+    {
+        Serial.println(F("[DEBUG] SNMPGETRESPONSE: SUCCESS"));
+    }
+#endif
+    return _parsed;
+}
+
+bool SNMPManager::onHeader(int version, const char *community, ASN_TYPE pduType, unsigned long requestID, int errorStatus, int errorIndex)
+{
+    if (pduType != GetResponsePDU)
+    {
+        return false; // Nothing to pass on to the value handlers
+    }
+    PendingRequest *pending = findPendingRequest(_remoteIP, requestID);
+    if (pending)
+    {
+        // A tracked request, matched on request ID and source address, so it is handed to its owner.
+        SNMPRequestOwner *owner = pending->owner;
+        SNMPAgent *agent = endRequest(pending);
+        if (agent && agent->requestAnswered() && _agentStateCallback)
+        {
+            _agentStateCallback(agent->ip, agent->state);
+        }
+        if (owner->onResponse(_remoteIP, requestID, errorStatus, errorIndex, pending->tag))
+        {
+            return false;
+        }
+        _responseOwner = owner;
+        _responseRequestID = requestID;
+        _responseTag = pending->tag;
+    }
+    else if (_rangeOwner && requestID - _rangeFirstID < _rangeCount)
+    {
+        if (_rangeOwner->onResponse(_remoteIP, requestID, errorStatus, errorIndex, 0))
+        {
+            return false;
+        }
+        _responseOwner = _rangeOwner;
+        _responseRequestID = requestID;
+        _responseTag = 0;
+    }
+    else if (version != SNMP_VERSION_3 + 1 && !validCommunity(version, community))
+    {
+        Serial.print(F("Invalid community or version - Community: "));
+        Serial.print(community);
+        Serial.print(F(" - Version: "));
+        Serial.println(version);
+        _parsed = false;
+        return false;
+    }
+    else if (errorStatus)
+    {
+        // The varbinds of an error response are those of the request, there are no values to pass on
+        Serial.print(F("Error response from: "));
+        Serial.print(_remoteIP);
+        Serial.print(F(" - Error Status: "));
+        Serial.print(errorStatus);
+        Serial.print(F(" - Error Index: "));
+        Serial.println(errorIndex);
+        return false;
+    }
+#ifdef DEBUG
+    Serial.print(F("[DEBUG] Community: "));
+    Serial.println(community);
+    Serial.print(F("[DEBUG] SNMP Version: "));
+    Serial.println(version);
 #endif
-    delete snmpgetresponse;
     return true;
 }
 
-ValueCallback *SNMPManager::findCallback(IPAddress ip, const char *oid)
+bool SNMPManager::onVarBind(const unsigned char *oid, uint8_t oidLength, BER_CONTAINER *responseContainer)
 {
-    callbacksCursor = callbacks;
+    ASN_TYPE responseType = responseContainer->_type;
+#ifdef DEBUG
+    Serial.print(F("[DEBUG] Response from: "));
+    Serial.print(_remoteIP);
+    Serial.print(F(" - OID: "));
+    printOID(oid, oidLength);
+    Serial.println();
+#endif
+    if (_responseOwner && _responseOwner->onResponseVarBind(_remoteIP, oid, oidLength, responseContainer, _responseTag))
+    {
+        return true;
+    }
+    uint8_t prefixLength = 0;
+    ValueCallback *callback = _agent ? _agent->findHandler(oid, oidLength, &prefixLength) : 0;
+    if (!callback)
+    {
+        Serial.print(F("Matching callback not found for received SNMP response. Response OID: "));
+        printOID(oid, oidLength);
+        Serial.print(F(" - From IP Address: "));
+        Serial.println(_remoteIP);
+        _parsed = false;
+        return false;
+    }
+    if (callback->isPrefix)
+    {
+        // The callback gets the value whatever its type, along with the subidentifiers identifying the instance
+        uint32_t instance[SNMP_MAX_INSTANCE_ARCS];
+        int instanceLength = berDecodeArcs(oid + prefixLength, oidLength - prefixLength, instance, SNMP_MAX_INSTANCE_ARCS);
+        if (instanceLength < 0)
+        {
+            Serial.print(F("Too many subidentifiers for prefix handler: "));
+            printOID(oid, oidLength);
+            Serial.println();
+            return true;
+        }
+        callback->prefixCallback(_remoteIP, callback, instance, instanceLength, responseContainer);
+        return true;
+    }
+    ASN_TYPE callbackType = callback->type;
+    if (callbackType != responseType)
+    {
+        switch (responseType)
+        {
+        case NOSUCHOBJECT:
+        {
+            Serial.print(F("No such object: "));
+        }
+        break;
+        case NOSUCHINSTANCE:
+        {
+            Serial.print(F("No such instance: "));
+        }
+        break;
+        case ENDOFMIBVIEW:
+        {
+            Serial.print(F("End of MIB view when calling: "));
+        }
+        break;
+        default:
+        {
+            Serial.print(F("Incorrect Callback type. Expected: "));
+            Serial.print(callbackType);
+            Serial.print(F(" Received: "));
+            Serial.print(responseType);
+            Serial.print(F(" - When calling: "));
+        }
+        }
+        printOID(oid, oidLength);
+        Serial.println();
+        _parsed = false;
+        return false;
+    }
+    if (callback->history)
+    {
+        recordHistory(callback, responseContainer);
+    }
+    float number;
+    if (callback->alarmCondition && _alarms && numericValue(callback, responseContainer, &number))
+    {
+        // Every value received is tested, changed or not, so the rate of change is up to date
+        uint64_t count = callback->type == COUNTER64 ? ((Counter64 *)responseContainer)->_value : (uint32_t)((IntegerType *)responseContainer)->_value;
+        _alarms->evaluate(callback, number, count, millis());
+    }
+    if (storeValue(callback, responseContainer))
+    {
+        if (!_changedValues++)
+        {
+            _generation++;
+        }
+        _agent->markChanged(callback, _generation);
+#ifndef SNMP_SNAPSHOTS
+        ValueChangeCallback onChange = callback->changeCallback ? callback->changeCallback : _changeCallback;
+        if (onChange)
+        {
+            onChange(_remoteIP, callback);
+        }
+#endif
+    }
+    return true;
+}
+
+void SNMPManager::recordHistory(ValueCallback *callback, BER_CONTAINER *responseContainer)
+{
+    // Every value received is recorded, changed or not, so the samples are evenly spaced
+    unsigned long now = millis();
+    float number;
+    if (callback->type == COUNTER32)
+    {
+        callback->history->addCounter(now, (uint32_t)((IntegerType *)responseContainer)->_value, true);
+    }
+    else if (callback->type == COUNTER64)
+    {
+        callback->history->addCounter(now, ((Counter64 *)responseContainer)->_value, false);
+    }
+    else if (numericValue(callback, responseContainer, &number))
+    {
+        callback->history->add(now, number);
+    }
+}
+
+bool SNMPManager::numericValue(ValueCallback *callback, BER_CONTAINER *responseContainer, float *number)
+{
+    // The received value as it is stored, as a float
+    switch (callback->type)
+    {
+    case INTEGER:
+    {
+        long received = ((IntegerType *)responseContainer)->_value;
+        *number = callback->isFloat ? received / 10.0f : received;
+    }
+    break;
+    case COUNTER32:
+    case GAUGE32:
+    case TIMESTAMP:
+        *number = (uint32_t)((IntegerType *)responseContainer)->_value;
+        break;
+    case COUNTER64:
+        *number = ((Counter64 *)responseContainer)->_value;
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
 
-    if (callbacksCursor->value)
+bool SNMPManager::writeValue(ValueCallback *callback, const void *value, uint16_t size)
+{
+#ifdef SNMP_SNAPSHOTS
+    if (!_writing)
     {
-        while (true)
+        if (_stage.add(callback, value, size))
         {
-            memset(OIDBuf, 0, MAX_OID_LENGTH);
-            strcat(OIDBuf, callbacksCursor->value->OID);
-            if ((strcmp(OIDBuf, oid) == 0) && (callbacksCursor->value->ip == ip))
+            return true;
+        }
+        // More values than fit: the staged ones are written and the write section is held open for the rest of the response,
+        // so readers still never see part of it
+        _seqLock.writeBegin();
+        _stage.write();
+        _writing = true;
+    }
+    memcpy(callback->type == STRING ? *(char **)callback->value : callback->value, value, size);
+    return true;
+#else
+    _seqLock.writeBegin();
+    memcpy(callback->type == STRING ? *(char **)callback->value : callback->value, value, size);
+    _seqLock.writeEnd();
+    return true;
+#endif
+}
+
+#ifdef SNMP_SNAPSHOTS
+void SNMPManager::commitValues()
+{
+    if (_writing)
+    {
+        _writing = false;
+        _seqLock.writeEnd();
+        _stage.clear();
+        // Not every value was staged, so the handlers changed are found by their generation, and reported in slot order
+        for (ValueCallback *callback = _agent ? _agent->nextChanged(0, _generation) : 0; callback; callback = _agent ? _agent->nextChanged(callback, _generation) : 0)
+        {
+            ValueChangeCallback onChange = callback->changeCallback ? callback->changeCallback : _changeCallback;
+            if (onChange)
             {
-// Found
+                onChange(_remoteIP, callback);
+            }
+        }
+        return;
+    }
+    if (_stage.isEmpty())
+    {
+        return;
+    }
+    _seqLock.writeBegin();
+    _stage.write();
+    _seqLock.writeEnd();
+    // The change callbacks see every value of the response already stored
+    uint16_t offset = 0;
+    while (ValueCallback *callback = _stage.callbackAt(&offset))
+    {
+        ValueChangeCallback onChange = callback->changeCallback ? callback->changeCallback : _changeCallback;
+        if (onChange)
+        {
+            onChange(_remoteIP, callback);
+        }
+    }
+    _stage.clear();
+}
+#endif
+
+bool SNMPManager::pastDeadband(ValueCallback *callback, float difference, float stored)
+{
+    if (!callback->deadband)
+    {
+        return true;
+    }
+    float limit = callback->deadbandPercent ? callback->deadband * fabsf(stored) / 100 : callback->deadband;
+    return fabsf(difference) >= limit;
+}
+
+uint32_t SNMPManager::stringHash(const char *value, size_t length)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261UL;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ (unsigned char)value[i]) * 16777619UL;
+    }
+    return hash;
+}
+
+bool SNMPManager::storeValue(ValueCallback *callback, BER_CONTAINER *responseContainer)
+{
+    // The value is only written when it has changed (by more than the deadband), returning whether it was
+    bool stored = callback->hasValue;
+    switch (callback->type)
+    {
+    case STRING:
+    {
+#ifdef DEBUG
+        Serial.println("[DEBUG] Type: String");
+#endif
+        const char *received = ((OctetType *)responseContainer)->_value;
+        size_t length = strlen(received);
+        uint32_t hash = stringHash(received, length);
+        if (stored && length == callback->stringLength && hash == callback->stringHash)
+        {
+            return false;
+        }
+        // Note: Requires that the size of the variable used to store the response is big enough.
+        // Otherwise move responsibility for the creation of the variable to store the value here, but this would put the onus on the caller to free and reset to null.
+        if (!writeValue(callback, received, length + 1))
+        {
+            return false;
+        }
+        callback->stringLength = length;
+        callback->stringHash = hash;
+    }
+    break;
+    case INTEGER:
+    {
 #ifdef DEBUG
-                Serial.println(F("[DEBUG] Found callback with matching IP"));
+        Serial.println("[DEBUG] Type: Integer");
 #endif
-                return callbacksCursor->value;
+        if (!callback->isFloat)
+        {
+            int received = ((IntegerType *)responseContainer)->_value;
+            int *value = (int *)callback->value;
+            if (stored && (received == *value || !pastDeadband(callback, (float)received - *value, *value)))
+            {
+                return false;
             }
-            if (callbacksCursor->next)
+            if (!writeValue(callback, &received, sizeof(received)))
             {
-                callbacksCursor = callbacksCursor->next;
+                return false;
             }
-            else
+        }
+        else
+        {
+            float received = (long)((IntegerType *)responseContainer)->_value / 10.0f;
+            float *value = (float *)callback->value;
+            if (stored && (received == *value || !pastDeadband(callback, received - *value, *value)))
             {
+                return false;
+            }
+            if (!writeValue(callback, &received, sizeof(received)))
+            {
+                return false;
+            }
+        }
+    }
+    break;
+    case COUNTER32:
+    case GAUGE32:
+    case TIMESTAMP:
+    {
 #ifdef DEBUG
-                Serial.println(F("[DEBUG] No matching callback found."));
+        Serial.print(F("[DEBUG] Type: "));
+        Serial.println(callback->type == COUNTER32 ? F("Counter32") : callback->type == GAUGE32 ? F("Gauge32") : F("TimeStamp"));
 #endif
-                break;
-            }
+        uint32_t received = ((IntegerType *)responseContainer)->_value;
+        uint32_t *value = (uint32_t *)callback->value;
+        // A counter only goes up, so the difference is taken across a wrap
+        float difference = callback->type == COUNTER32 ? (float)(uint32_t)(received - *value) : (float)received - *value;
+        if (stored && (received == *value || !pastDeadband(callback, difference, *value)))
+        {
+            return false;
+        }
+        if (!writeValue(callback, &received, sizeof(received)))
+        {
+            return false;
         }
     }
-    return 0;
+    break;
+    case COUNTER64:
+    {
+#ifdef DEBUG
+        Serial.println("[DEBUG] Type: Counter64");
+#endif
+        uint64_t received = ((Counter64 *)responseContainer)->_value;
+        uint64_t *value = (uint64_t *)callback->value;
+        if (stored && (received == *value || !pastDeadband(callback, (float)(received - *value), *value)))
+        {
+            return false;
+        }
+        if (!writeValue(callback, &received, sizeof(received)))
+        {
+            return false;
+        }
+    }
+    break;
+    default:
+    {
+#ifdef DEBUG
+        Serial.print(F("[DEBUG] Unsupported Type: "));
+        Serial.print(callback->type);
+#endif
+        return false;
+    }
+    }
+    callback->hasValue = true;
+    return true;
+}
+
+ValueCallback *SNMPManager::findCallback(IPAddress ip, const char *oid)
+{
+    SNMPAgent *agent = _agents.find(ip);
+    unsigned char encoded[SNMP_MAX_OID_BYTES];
+    int length = berEncodeOID(oid, encoded, SNMP_MAX_OID_BYTES);
+    return (agent && length) ? agent->findHandler(encoded, length) : 0;
+}
+
+ValueCallback *SNMPManager::addHandler(IPAddress ip, const char *oid, ASN_TYPE type, void *value)
+{
+    // Handlers are kept with their agent, so a response only has to be matched against that agent's OIDs
+    return _agents.add(ip)->addHandler(oid, type, value);
+}
+
+int SNMPManager::addHandlers(const SNMPHandlerEntry *table, int count)
+{
+    return addHandlers(table, count, false);
+}
+
+int SNMPManager::addHandlers_P(const SNMPHandlerEntry *table, int count)
+{
+    return addHandlers(table, count, true);
+}
+
+int SNMPManager::addHandlers(const SNMPHandlerEntry *table, int count, bool progmem)
+{
+    // First count the rows for each agent, so each agent's handlers from the table take a single allocation
+    SNMPHandlerEntry entry;
+    for (int i = 0; i < count; i++)
+    {
+        if (progmem)
+        {
+            memcpy_P(&entry, &table[i], sizeof(entry));
+        }
+        else
+        {
+            entry = table[i];
+        }
+        _agents.add(IPAddress(entry.ip[0], entry.ip[1], entry.ip[2], entry.ip[3]))->reserveHandlers(1);
+    }
+    int added = 0;
+    char oid[MAX_OID_LENGTH];
+    for (int i = 0; i < count; i++)
+    {
+        if (progmem)
+        {
+            memcpy_P(&entry, &table[i], sizeof(entry));
+            strncpy_P(oid, entry.oid, MAX_OID_LENGTH - 1);
+            oid[MAX_OID_LENGTH - 1] = 0;
+        }
+        else
+        {
+            entry = table[i];
+        }
+        ValueCallback *callback = _agents.find(IPAddress(entry.ip[0], entry.ip[1], entry.ip[2], entry.ip[3]))->addHandler(progmem ? oid : entry.oid, entry.type, entry.value);
+        if (callback)
+        {
+            callback->isFloat = entry.isFloat;
+            added++;
+        }
+    }
+    return added;
+}
+
+void SNMPManager::setChangeCallback(ValueChangeCallback callback)
+{
+    _changeCallback = callback;
+}
+
+unsigned int SNMPManager::changedValues()
+{
+    return _changedValues;
+}
+
+unsigned int SNMPManager::responseLength()
+{
+    return _responseLength;
+}
+
+uint32_t SNMPManager::generation()
+{
+    return _generation;
+}
+
+int SNMPManager::forEachChanged(uint32_t since, ValueChangeCallback callback)
+{
+    return _agents.forEachChanged(since, _generation, callback);
+}
+
+uint32_t SNMPManager::readBegin()
+{
+    return _seqLock.readBegin();
+}
+
+bool SNMPManager::readRetry(uint32_t sequence)
+{
+    return _seqLock.readRetry(sequence);
+}
+
+ValueCallback *SNMPManager::addPrefixHandler(IPAddress ip, const char *oid, PrefixValueCallback callback)
+{
+    return _agents.add(ip)->addPrefixHandler(oid, callback);
 }
 
 ValueCallback *SNMPManager::addStringHandler(IPAddress ip, const char *oid, char **value)
 {
-    ValueCallback *callback = new StringCallback();
-    callback->OID = (char *)malloc((sizeof(char) * strlen(oid)) + 1);
-    strcpy(callback->OID, oid);
-    ((StringCallback *)callback)->value = value;
-    callback->ip = ip;
-    addHandler(callback);
-    return callback;
+    return addHandler(ip, oid, STRING, value);
 }
 
 ValueCallback *SNMPManager::addIntegerHandler(IPAddress ip, const char *oid, int *value)
 {
-    ValueCallback *callback = new IntegerCallback();
-    callback->OID = (char *)malloc((sizeof(char) * strlen(oid)) + 1);
-    strcpy(callback->OID, oid);
-    ((IntegerCallback *)callback)->value = value;
-    ((IntegerCallback *)callback)->isFloat = false;
-    callback->ip = ip;
-    addHandler(callback);
-    return callback;
+    return addHandler(ip, oid, INTEGER, value);
 }
 
 ValueCallback *SNMPManager::addFloatHandler(IPAddress ip, const char *oid, float *value)
 {
-    ValueCallback *callback = new IntegerCallback();
-    callback->OID = (char *)malloc((sizeof(char) * strlen(oid)) + 1);
-    strcpy(callback->OID, oid);
-    ((IntegerCallback *)callback)->value = (int *)value;
-    ((IntegerCallback *)callback)->isFloat = true;
-    callback->ip = ip;
-    addHandler(callback);
+    ValueCallback *callback = addHandler(ip, oid, INTEGER, value);
+    if (callback)
+    {
+        callback->isFloat = true;
+    }
     return callback;
 }
 
 ValueCallback *SNMPManager::addTimestampHandler(IPAddress ip, const char *oid, uint32_t *value)
 {
-    ValueCallback *callback = new TimestampCallback();
-    callback->OID = (char *)malloc((sizeof(char) * strlen(oid)) + 1);
-    strcpy(callback->OID, oid);
-    ((TimestampCallback *)callback)->value = value;
-    callback->ip = ip;
-    addHandler(callback);
-    return callback;
+    return addHandler(ip, oid, TIMESTAMP, value);
 }
 
 ValueCallback *SNMPManager::addOIDHandler(IPAddress ip, const char *oid, char *value)
 {
-    ValueCallback *callback = new OIDCallback();
-    callback->OID = (char *)malloc((sizeof(char) * strlen(oid)) + 1);
-    ((OIDCallback *)callback)->value = value;
-    callback->ip = ip;
-    addHandler(callback);
-    return callback;
+    return addHandler(ip, oid, ASN_TYPE::OID, value);
 }
 
 ValueCallback *SNMPManager::addCounter64Handler(IPAddress ip, const char *oid, uint64_t *value)
 {
-    ValueCallback *callback = new Counter64Callback();
-    callback->OID = (char *)malloc((sizeof(char) * strlen(oid)) + 1);
-    strcpy(callback->OID, oid);
-    ((Counter64Callback *)callback)->value = value;
-    callback->ip = ip;
-    addHandler(callback);
-    return callback;
+    return addHandler(ip, oid, COUNTER64, value);
 }
 
 ValueCallback *SNMPManager::addCounter32Handler(IPAddress ip, const char *oid, uint32_t *value)
 {
-    ValueCallback *callback = new Counter32Callback();
-    callback->OID = (char *)malloc((sizeof(char) * strlen(oid)) + 1);
-    strcpy(callback->OID, oid);
-    ((Counter32Callback *)callback)->value = value;
-    callback->ip = ip;
-    addHandler(callback);
-    return callback;
+    return addHandler(ip, oid, COUNTER32, value);
 }
 
 ValueCallback *SNMPManager::addGaugeHandler(IPAddress ip, const char *oid, uint32_t *value)
 {
-    ValueCallback *callback = new Gauge32Callback();
-    callback->OID = (char *)malloc((sizeof(char) * strlen(oid)) + 1);
-    strcpy(callback->OID, oid);
-    ((Gauge32Callback *)callback)->value = value;
-    callback->ip = ip;
-    addHandler(callback);
-    return callback;
+    return addHandler(ip, oid, GAUGE32, value);
 }
 
-void SNMPManager::addHandler(ValueCallback *callback)
-{
-    callbacksCursor = callbacks;
-    if (callbacksCursor->value)
-    {
-        while (callbacksCursor->next != 0)
-        {
-            callbacksCursor = callbacksCursor->next;
-        }
-        callbacksCursor->next = new ValueCallbacks();
-        callbacksCursor = callbacksCursor->next;
-        callbacksCursor->value = callback;
-        callbacksCursor->next = 0;
-    }
-    else
-        callbacks->value = callback;
-}
+#include "SNMPGet.h"
+#include "SNMPSet.h"
+#include "SNMPTable.h"
+#include "SNMPPollGroup.h"
+#include "SNMPDiscovery.h"
+#include "SNMPCache.h"
 
 #endif
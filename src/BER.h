@@ -39,9 +39,318 @@ typedef enum ASN_TYPE_WITH_VALUE
     SetRequestPDU = 0xA3,
     TrapPDU = 0xA4,
     GetBulkRequestPDU = 0xA5,
-    Trapv2PDU = 0xA7
+    Trapv2PDU = 0xA7,
+    ReportPDU = 0xA8
 } ASN_TYPE;
 
+// Helpers for writing BER headers directly into a buffer, used where packets are assembled without building a ComplexType tree.
+
+inline int berLengthSize(unsigned int length)
+{
+    // Number of bytes needed for the length field, short form below 128, long form up to 65535
+    return length < 0x80 ? 1 : (length < 0x100 ? 2 : 3);
+}
+
+inline int berWriteLength(unsigned char *buf, unsigned int length)
+{
+    if (length < 0x80)
+    {
+        *buf = length;
+        return 1;
+    }
+    if (length < 0x100)
+    {
+        *buf++ = 0x81;
+        *buf = length;
+        return 2;
+    }
+    *buf++ = 0x82;
+    *buf++ = length >> 8;
+    *buf = length & 0xFF;
+    return 3;
+}
+
+// Integer codec for INTEGER and the unsigned application types (Counter32, Gauge32, TimeTicks, Counter64).
+// U is the unsigned type the value is held in, isSigned selects two's complement sign handling.
+
+inline bool berIsSigned(ASN_TYPE type)
+{
+    // Only INTEGER is signed, the application types are all unsigned and may need a leading zero byte
+    return type == INTEGER;
+}
+
+template <typename U>
+inline int berIntegerLength(U value, bool isSigned)
+{
+    // Minimal two's complement length: a negative value needs as many bytes as its complement
+    if (isSigned && (value >> (sizeof(U) * 8 - 1)))
+    {
+        value = ~value;
+    }
+    int length = 1;
+    for (U rest = value >> 7; rest; rest >>= 8)
+    {
+        length++;
+    }
+    return length;
+}
+
+template <typename U>
+inline int berEncodeInteger(unsigned char *buf, ASN_TYPE type, U value, bool isSigned)
+{
+    // Writes type, length and the minimum number of content bytes for value
+    int length = berIntegerLength(value, isSigned);
+    *buf++ = type;
+    *buf++ = length;
+    int bytes = length;
+    if (bytes > (int)sizeof(U))
+    {
+        // Unsigned with the top bit set, so preceded by a zero byte
+        *buf++ = 0;
+        bytes = sizeof(U);
+    }
+    switch (bytes)
+    {
+    case 4:
+        *buf++ = value >> 24;
+        // fall through
+    case 3:
+        *buf++ = value >> 16;
+        // fall through
+    case 2:
+        *buf++ = value >> 8;
+        // fall through
+    case 1:
+        *buf = value;
+        break;
+    default:
+        for (int i = bytes - 1; i >= 0; i--)
+        {
+            buf[i] = value;
+            value >>= 8;
+        }
+        break;
+    }
+    return length + 2;
+}
+
+template <typename U>
+inline U berDecodeInteger(const unsigned char *ptr, unsigned int length, bool isSigned)
+{
+    // Content bytes only. Signed values are sign extended, a leading zero on an unsigned value shifts out.
+    U value = (isSigned && length && (*ptr & 0x80)) ? ~(U)0 : 0;
+    switch (length)
+    {
+    case 0:
+        return 0;
+    case 1:
+        return (value << 8) | ptr[0];
+    case 2:
+        return (value << 16) | ((U)ptr[0] << 8) | ptr[1];
+    case 3:
+        return (value << 24) | ((U)ptr[0] << 16) | ((U)ptr[1] << 8) | ptr[2];
+    case 4:
+        return ((value << 16) << 16) | ((U)ptr[0] << 24) | ((U)ptr[1] << 16) | ((U)ptr[2] << 8) | ptr[3]; // Two shifts, as U may be 32 bits
+    default:
+        while (length--)
+        {
+            value = (value << 8) | *ptr++;
+        }
+        return value;
+    }
+}
+
+inline int berWriteInteger(unsigned char *buf, ASN_TYPE type, long value)
+{
+    return berEncodeInteger<unsigned long>(buf, type, value, berIsSigned(type));
+}
+
+inline bool berReadHeader(unsigned char *&ptr, unsigned char *end, unsigned char &type, unsigned int &length)
+{
+    // Reads type and length, leaving ptr at the start of the value. Fails if the value would run past end.
+    if (end - ptr < 2)
+    {
+        return false;
+    }
+    type = *ptr++;
+    length = *ptr++;
+    if (length > 127)
+    {
+        int numBytes = length & 0x7F;
+        if (numBytes > 2 || end - ptr < numBytes)
+        {
+            return false;
+        }
+        length = 0;
+        while (numBytes--)
+        {
+            length = (length << 8) | *ptr++;
+        }
+    }
+    return length <= (unsigned int)(end - ptr);
+}
+
+inline long berReadInteger(const unsigned char *ptr, unsigned int length)
+{
+    return (long)berDecodeInteger<unsigned long>(ptr, length, true);
+}
+
+// Bytes needed to encode one subidentifier
+inline int berArcLength(unsigned long value)
+{
+    int bytes = 1;
+    for (unsigned long rest = value >> 7; rest; rest >>= 7)
+    {
+        bytes++;
+    }
+    return bytes;
+}
+
+// Encodes one subidentifier, base 128 with the high bit set on all but the last byte. Returns its length.
+inline int berEncodeArc(unsigned long value, unsigned char *buf)
+{
+    int bytes = berArcLength(value);
+    for (int i = bytes - 1; i >= 0; i--)
+    {
+        buf[i] = (value & 0x7F) | (i == bytes - 1 ? 0 : 0x80);
+        value >>= 7;
+    }
+    return bytes;
+}
+
+inline int berEncodeOID(const char *oid, unsigned char *buf, int size)
+{
+    // Encodes a dotted OID (".1.3.6.1...") as BER content bytes. Returns the length, or 0 if invalid or longer than size.
+    unsigned long first = 0;
+    int arc = 0;
+    int length = 0;
+    if (*oid == '.')
+    {
+        oid++;
+    }
+    while (*oid)
+    {
+        if (*oid < '0' || *oid > '9')
+        {
+            return 0;
+        }
+        unsigned long value = strtoul(oid, (char **)&oid, 10);
+        if (*oid == '.')
+        {
+            oid++;
+        }
+        if (arc++ == 0)
+        {
+            first = value; // The first two arcs share one subidentifier
+            continue;
+        }
+        if (arc == 2)
+        {
+            value += first * 40;
+        }
+        if (length + berArcLength(value) > size)
+        {
+            return 0;
+        }
+        length += berEncodeArc(value, buf + length);
+    }
+    return arc >= 2 ? length : 0;
+}
+
+inline int berDecodeOID(const unsigned char *oid, int length, char *buf, int size)
+{
+    // Writes the dotted form of BER OID content bytes to buf. Returns the string length, or -1 if it didn't fit.
+    int used = 0;
+    unsigned long value = 0;
+    bool first = true;
+    for (int i = 0; i < length; i++)
+    {
+        value = (value << 7) | (oid[i] & 0x7F);
+        if (oid[i] & 0x80)
+        {
+            continue;
+        }
+        int written;
+        if (first)
+        {
+            unsigned long x = value < 80 ? value / 40 : 2;
+            written = snprintf(buf + used, size - used, ".%lu.%lu", x, value - x * 40);
+            first = false;
+        }
+        else
+        {
+            written = snprintf(buf + used, size - used, ".%lu", value);
+        }
+        if (written < 0 || used + written >= size)
+        {
+            return -1;
+        }
+        used += written;
+        value = 0;
+    }
+    buf[used] = 0;
+    return used;
+}
+
+// Decodes BER encoded subidentifiers without combining the first two, e.g. the instance part of an OID. Returns the count, or -1 if more than size.
+inline int berDecodeArcs(const unsigned char *oid, int length, uint32_t *arcs, int size)
+{
+    int count = 0;
+    uint32_t value = 0;
+    for (int i = 0; i < length; i++)
+    {
+        value = (value << 7) | (oid[i] & 0x7F);
+        if (oid[i] & 0x80)
+        {
+            continue;
+        }
+        if (count == size)
+        {
+            return -1;
+        }
+        arcs[count++] = value;
+        value = 0;
+    }
+    return count;
+}
+
+// Writes a PDU header for a varbind list of varBindsLength bytes, which the caller writes straight after.
+// For GetBulkRequest errorStatus and errorIndex carry non-repeaters and max-repetitions.
+inline int berWritePDUHeader(unsigned char *buf, ASN_TYPE pduType, unsigned long requestID, int varBindsLength, int errorStatus = 0, int errorIndex = 0)
+{
+    unsigned char fields[18];
+    int fieldsLength = berWriteInteger(fields, INTEGER, requestID);
+    fieldsLength += berWriteInteger(fields + fieldsLength, INTEGER, errorStatus);
+    fieldsLength += berWriteInteger(fields + fieldsLength, INTEGER, errorIndex);
+    unsigned char *ptr = buf;
+    *ptr++ = pduType;
+    ptr += berWriteLength(ptr, fieldsLength + 1 + berLengthSize(varBindsLength) + varBindsLength);
+    memcpy(ptr, fields, fieldsLength);
+    ptr += fieldsLength;
+    *ptr++ = STRUCTURE;
+    ptr += berWriteLength(ptr, varBindsLength);
+    return ptr - buf;
+}
+
+// Writes the SNMPv1/v2c message header (SEQUENCE, version, community) followed by the PDU header.
+inline int berWriteMessageHeader(unsigned char *buf, const char *community, short version, ASN_TYPE pduType, unsigned long requestID, int varBindsLength, int errorStatus = 0, int errorIndex = 0)
+{
+    unsigned char pduHeader[28];
+    int pduHeaderLength = berWritePDUHeader(pduHeader, pduType, requestID, varBindsLength, errorStatus, errorIndex);
+    int communityLength = strlen(community);
+    int messageLength = 3 + 1 + berLengthSize(communityLength) + communityLength + pduHeaderLength + varBindsLength;
+    unsigned char *ptr = buf;
+    *ptr++ = STRUCTURE;
+    ptr += berWriteLength(ptr, messageLength);
+    ptr += berWriteInteger(ptr, INTEGER, version);
+    *ptr++ = STRING;
+    ptr += berWriteLength(ptr, communityLength);
+    memcpy(ptr, community, communityLength);
+    ptr += communityLength;
+    memcpy(ptr, pduHeader, pduHeaderLength);
+    return (ptr - buf) + pduHeaderLength;
+}
+
 // Primitive types inherits straight off the container, complex come off complexType.
 // All primitives have to serialise themselves (type, length, data), to be put straight into the packet.
 // For deserialising from the parent container we check the type, then create an object of that type and call deSerialise,
@@ -121,61 +430,18 @@ public:
         Serial.println("[DEBUG_BER] IntegerType:serialise");
 #endif
         // here we print out the BER encoded ASN.1 bytes, which includes type, length and value. we return the length of the entire block (TL&V) in bytes;
-        unsigned char *ptr = buf;
-        *ptr = _type;
-        ptr++;
-        unsigned char *lengthPtr = ptr++;
-
-        // // For values <= 127 we use a single byte for the value
-        if (_value != 0 && _value <= 0x7F)
-        {
-            _length = 1;
-            *ptr++ = _value;
-        }
-        else if (_value != 0 && _value >= 0x80)
-        {
-            // Determine the number of bytes required for encoding
-            uint32_t temp = _value;
-            _length = 0;
-            while (temp > 0) {
-                temp >>= 8;
-                _length++;
-            }
-            // Multi-byte encoding
-            *ptr++ = 0x80 | _length;  // Tag for multi-byte encoding
-
-            for (size_t i = 1; i <= _length; i++) {
-                *ptr++ = _value & 0xFF;  // Store the least significant byte
-                _value >>= 8;
-            }
-            _length++;
-        }
-        else
-        {
-            _length = 1;
-            *ptr = 0;
-        }
-        *lengthPtr = _length;
-        return _length + 2;
+        int length = berEncodeInteger(buf, _type, _value, berIsSigned(_type));
+        _length = length - 2;
+        return length;
     }
     bool fromBuffer(unsigned char *buf)
     {
 #ifdef DEBUG_BER
         Serial.println("[DEBUG_BER] Integer:fromBuffer");
 #endif
-        buf++; // skip Type
-        _length = *buf;
-        buf++;
-        unsigned short tempLength = _length;
-        //        _value = *buf; // TODO: make work for integers more than 255
-        _value = 0;
-        while (tempLength > 0)
-        {
-            _value = _value << 8;
-            _value = _value | *buf++;
-            tempLength--;
-        }
-        return true;
+        _length = buf[1];
+        _value = berDecodeInteger<unsigned long>(buf + 2, _length, berIsSigned(_type));
+        return _length <= sizeof(_value) + 1;
     }
     int getLength()
     {
@@ -203,8 +469,8 @@ public:
     OctetType() : BER_CONTAINER(true, STRING){};
     OctetType(char *value) : BER_CONTAINER(true, STRING)
     {
-        strncpy(_value, value, sizeof(_value));
-        _value[sizeof(_value)] = 0;
+        strncpy(_value, value, sizeof(_value) - 1);
+        _value[sizeof(_value) - 1] = 0;
     };
     ~OctetType(){};
     char _value[SNMP_OCTETSTRING_MAX_LENGTH];
@@ -298,119 +564,18 @@ public:
         Serial.println("[DEBUG_BER] OIDType:serialise");
 #endif
         // here we print out the BER encoded ASN.1 bytes, which includes type, length and value.
-        char *ptr = (char *)buf;
-        *ptr = _type;
-        ptr++;
-        char *lengthPtr = ptr;
-        ptr++;
-        *ptr = 0x2b;
-        char *internalPtr = ++ptr;
-        char *valuePtr = &_value[5];
-        _length = 3;
-        bool toBreak = false;
-        while (true)
-        {
-            char *start = valuePtr;
-            char *end = strchr(start, '.');
-
-            if (!end)
-            {
-                end = strchr(start, 0);
-                toBreak = true;
-            }
-            char tempBuf[12];
-            memset(tempBuf, 0, 12);
-            //            char* tempBuf = (char*) malloc(sizeof(char) * (end-start));
-            strncpy(tempBuf, start, end - start + 1);
-            long tempVal;
-            char *pEnd;
-            tempVal = (uint32_t)strtoul(tempBuf, &pEnd, 10);
-            if (tempVal < 128)
-            {
-                _length += 1;
-                *ptr++ = (char)tempVal;
-            }
-            else
-            {
-                // Serial.print("large num: ");Serial.println(tempVal);
-                // FIXME: This will only encode integers upto 4 bytes. Ideally this should be a loop.
-                if (tempVal / 128 / 128 > 128)
-                {
-                    *ptr++ = ((tempVal / 128 / 128 / 128 ) | 0x80) & 0xFF;
-                    _length += 1;
-                }
-                if (tempVal / 128 > 128)
-                {
-                    *ptr++ = ((tempVal / 128 / 128) | 0x80) & 0xFF;
-                    _length += 1;
-                }
-                *ptr++ = ((tempVal / 128) | 0x80) & 0xFF;
-
-                *ptr++ = tempVal % 128 & 0xFF;
-                _length += 2;
-            }
-
-            valuePtr = end + 1;
-
-            //            free(tempBuf);
-            if (toBreak)
-                break;
-            // delay(1);
-        }
-        *lengthPtr = _length - 2;
-
-        return _length;
+        _length = berEncodeOID(_value, buf + 2, 127);
+        buf[0] = _type;
+        buf[1] = _length;
+        return _length + 2;
     }
     bool fromBuffer(unsigned char *buf)
     {
 #ifdef DEBUG_BER
         Serial.println("[DEBUG_BER] OIDType:fromBuffer");
 #endif
-        buf++; // skip Type
-        _length = *buf;
-        buf++;
-        buf++;
-        memset(_value, 0, 128);
-        _value[0] = '.';
-        _value[1] = '1';
-        _value[2] = '.';
-        _value[3] = '3'; // we fill in the first two bytes already
-        char *ptr = &_value[4];
-        char i = _length - 1;
-        while (i > 0)
-        {
-            if (*buf < 128)
-            { // we can keep raw
-                ptr += sprintf(ptr, ".%d", *buf);
-                i--;
-                buf++;
-            }
-            else
-            {                                   // we have to do the special >128 thing
-                long value = 0;                 // keep track of the actual thing
-                unsigned char n = 0;            // count how many large bits have been set
-                unsigned char tempBuf[6] = {0}; // no bigger than 4 bytes
-                while (*buf > 127)
-                {
-                    i--;
-                    *buf &= 0x7F;
-                    tempBuf[n] = *buf;
-                    n++;
-                    buf++;
-                }
-                value = *buf;
-                buf++;
-                i--;
-                for (unsigned char k = 0; k < n; k++)
-                {
-                    value += (pow(128, (n - k))) * tempBuf[k];
-                }
-                ptr += sprintf(ptr, ".%d", value);
-            }
-        }
-        // Serial.print("OID: " );Serial.println(_value);
-        //        memcpy(_value, buf, _length);
-        return true;
+        _length = buf[1];
+        return berDecodeOID(buf + 2, _length, _value, MAX_OID_LENGTH) >= 0;
     }
 
     int getLength()
@@ -464,49 +629,19 @@ public:
 #ifdef DEBUG_BER
         Serial.println("[DEBUG_BER] Counter64:serialise");
 #endif
-        // here we print out the BER encoded ASN.1 bytes, which includes type, length and value. we return the length of the entire block (TL&V) ni bytes;
-        unsigned char *ptr = buf;
-        *ptr = _type;
-        ptr++;
-        unsigned char *lengthPtr = ptr++;
-        if (_value != 0)
-        {
-            _length = 8;
-            *ptr++ = _value >> 56 & 0xFF;
-            *ptr++ = _value >> 48 & 0xFF;
-            *ptr++ = _value >> 40 & 0xFF;
-            *ptr++ = _value >> 32 & 0xFF;
-            *ptr++ = _value >> 24 & 0xFF;
-            *ptr++ = _value >> 16 & 0xFF;
-            *ptr++ = _value >> 8 & 0xFF;
-            *ptr++ = _value & 0xFF;
-        }
-        else
-        {
-            _length = 1;
-            *ptr = 0;
-        }
-        *lengthPtr = _length;
-        return _length + 2;
+        // here we print out the BER encoded ASN.1 bytes, which includes type, length and value. we return the length of the entire block (TL&V) in bytes;
+        int length = berEncodeInteger(buf, _type, _value, false);
+        _length = length - 2;
+        return length;
     }
     bool fromBuffer(unsigned char *buf)
     {
 #ifdef DEBUG_BER
         Serial.println("[DEBUG_BER] Counter64:fromBuffer");
 #endif
-        buf++; // skip Type
-        _length = *buf;
-        buf++;
-        unsigned short tempLength = _length;
-        //        _value = *buf; // TODO: make work for integers more than 255
-        _value = 0;
-        while (tempLength > 0)
-        {
-            _value = _value << 8;
-            _value = _value | *buf++;
-            tempLength--;
-        }
-        return true;
+        _length = buf[1];
+        _value = berDecodeInteger<uint64_t>(buf + 2, _length, false);
+        return _length <= sizeof(_value) + 1;
     }
     int getLength()
     {
@@ -555,6 +690,8 @@ typedef struct BER_LINKED_LIST
     struct BER_LINKED_LIST *next = 0;
 } ValuesList;
 
+inline BER_CONTAINER *berNewContainer(ASN_TYPE type);
+
 class ComplexType : public BER_CONTAINER
 {
 public:
@@ -613,57 +750,7 @@ public:
             buf++;
             i++;
 
-            BER_CONTAINER *newObj;
-            switch (valueType)
-            {
-            case STRUCTURE:
-            case GetRequestPDU:
-            case GetNextRequestPDU:
-            case GetResponsePDU:
-            case SetRequestPDU:
-            case GetBulkRequestPDU:
-            case TrapPDU: // should never get trap, but put it in anyway
-            case Trapv2PDU:
-                newObj = new ComplexType(valueType);
-                break;
-                // primitive
-            case INTEGER:
-                newObj = new IntegerType();
-                break;
-            case STRING:
-                newObj = new OctetType();
-                break;
-            case OID:
-                newObj = new OIDType();
-                break;
-            case NULLTYPE:
-                newObj = new NullType();
-                break;
-                // derived
-            case NETWORK_ADDRESS:
-                newObj = new NetworkAddress();
-                break;
-            case TIMESTAMP:
-                newObj = new TimestampType();
-                break;
-            case COUNTER32:
-                newObj = new Counter32();
-                break;
-            case GAUGE32:
-                newObj = new Gauge();
-                break;
-            case COUNTER64:
-                newObj = new Counter64();
-                break;
-                /* OPAQUE = 0x44 */
-
-            default:
-#ifdef DEBUG
-                Serial.println("[DEBUG_BER] default new ComplexType");
-#endif
-                newObj = new ComplexType(valueType);
-                break;
-            }
+            BER_CONTAINER *newObj = berNewContainer(valueType);
             newObj->fromBuffer(buf - (2 + doubleL));
 
             buf += valueLength;
@@ -779,4 +866,49 @@ public:
     }
 };
 
+// Creates an empty container of the right class for the type, ready for fromBuffer().
+inline BER_CONTAINER *berNewContainer(ASN_TYPE type)
+{
+    switch (type)
+    {
+    case STRUCTURE:
+    case GetRequestPDU:
+    case GetNextRequestPDU:
+    case GetResponsePDU:
+    case SetRequestPDU:
+    case GetBulkRequestPDU:
+    case TrapPDU: // should never get trap, but put it in anyway
+    case Trapv2PDU:
+    case ReportPDU:
+        return new ComplexType(type);
+        // primitive
+    case INTEGER:
+        return new IntegerType();
+    case STRING:
+        return new OctetType();
+    case OID:
+        return new OIDType();
+    case NULLTYPE:
+        return new NullType();
+        // derived
+    case NETWORK_ADDRESS:
+        return new NetworkAddress();
+    case TIMESTAMP:
+        return new TimestampType();
+    case COUNTER32:
+        return new Counter32();
+    case GAUGE32:
+        return new Gauge();
+    case COUNTER64:
+        return new Counter64();
+        /* OPAQUE = 0x44 */
+
+    default:
+#ifdef DEBUG
+        Serial.println("[DEBUG_BER] default new ComplexType");
+#endif
+        return new ComplexType(type);
+    }
+}
+
 #endif
\ No newline at end of file
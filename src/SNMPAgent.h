@@ -0,0 +1,873 @@
+#ifndef SNMPAgent_h
+#define SNMPAgent_h
+
+#ifndef SNMP_AGENT_HASH_BUCKETS
+#define SNMP_AGENT_HASH_BUCKETS 32 // Must be a power of two
+#endif
+
+#ifndef SNMP_MAX_OID_BYTES
+#define SNMP_MAX_OID_BYTES 32 // Longest OID a handler can be registered for, in BER encoded bytes (about 30 subidentifiers below 128)
+#endif
+
+#ifndef SNMP_HANDLER_BLOCK_SIZE
+#define SNMP_HANDLER_BLOCK_SIZE 8 // Handlers allocated at a time for each agent, unless more have been reserved
+#endif
+
+#define SNMP_VERSION_UNSET -1 // Agent added by registering a handler, accepts v1 and v2c and requests use their own version
+
+#ifndef SNMP_MAX_INSTANCE_ARCS
+#define SNMP_MAX_INSTANCE_ARCS 16 // Most subidentifiers after a prefix handler's OID passed to its callback
+#endif
+
+#ifndef SNMP_AGENT_INITIAL_WINDOW
+#define SNMP_AGENT_INITIAL_WINDOW 2 // Tracked requests an agent may have awaiting a response before it has answered any
+#endif
+
+#ifndef SNMP_AGENT_MAX_WINDOW
+#define SNMP_AGENT_MAX_WINDOW 16 // Most tracked requests an agent's window grows to
+#endif
+
+#ifndef SNMP_AGENT_MAX_REPETITIONS
+#define SNMP_AGENT_MAX_REPETITIONS 50 // Most rows a GetBulkRequest asks an agent for, however many would fit
+#endif
+
+#ifndef SNMP_AGENT_DOWN_TIMEOUTS
+#define SNMP_AGENT_DOWN_TIMEOUTS 3 // Consecutive timeouts before an agent is considered down
+#endif
+
+#ifndef SNMP_AGENT_PROBE_INTERVAL
+#define SNMP_AGENT_PROBE_INTERVAL 10000 // Milliseconds before the first probe of a down agent, doubling after each failed probe
+#endif
+
+#ifndef SNMP_AGENT_MAX_PROBE_INTERVAL
+#define SNMP_AGENT_MAX_PROBE_INTERVAL 600000 // Longest wait between probes of a down agent
+#endif
+
+enum SNMPAgentState
+{
+    SNMP_AGENT_UP,
+    SNMP_AGENT_SUSPECT, // Has missed a response, still sent requests as normal
+    SNMP_AGENT_DOWN     // Only sent a request now and then, as a probe
+};
+
+class SNMPAgent;
+
+// Called when an agent changes state.
+typedef void (*AgentStateCallback)(IPAddress ip, SNMPAgentState state);
+class ValueCallback;
+class SNMPHistory;
+
+// Called for each value received for an OID under a prefix handler's OID. instance holds the subidentifiers after the prefix,
+// e.g. the ifIndex for a prefix handler on a column of ifTable. value may be a noSuchInstance or endOfMibView exception.
+typedef void (*PrefixValueCallback)(IPAddress ip, ValueCallback *handler, const uint32_t *instance, uint8_t instanceLength, BER_CONTAINER *value);
+
+// Called after a handler's value has changed and been stored.
+typedef void (*ValueChangeCallback)(IPAddress ip, ValueCallback *handler);
+
+// Where the value of one OID from one agent is stored. The OID is held BER encoded so responses are matched without converting it.
+class ValueCallback
+{
+public:
+    union
+    {
+        void *value;                        // int, float, uint32_t, uint64_t, char * or char ** depending on type. Next free handler once removed.
+        PrefixValueCallback prefixCallback; // For prefix handlers
+    };
+    SNMPAgent *agent; // 0 once the handler has been removed
+    ValueChangeCallback changeCallback; // Called instead of the manager's change callback, if set
+    SNMPHistory *history;               // Records every value received, if set
+    union
+    {
+        float deadband;      // Numeric types, change from the stored value needed before a value is stored
+        uint32_t stringHash; // STRING, hash of the value last stored
+    };
+    uint16_t stringLength;
+    ASN_TYPE type;
+    bool isFloat = false;  // INTEGER stored in a float, divided by 10
+    bool isPrefix = false; // Receives every OID below its own, rather than its own
+    bool deadbandPercent;  // deadband is a percentage of the stored value
+    bool hasValue;         // A value has been stored since the handler was added
+    uint16_t slot;         // Index of the handler within its agent, its bit in the agent's dirty bitmap
+    uint32_t generation;   // Manager generation in which the value last changed, 0 if it hasn't
+    uint8_t alarmCondition; // First SNMPAlarms condition on the value, plus one, 0 for none
+    uint8_t oidLength;
+    unsigned char oid[SNMP_MAX_OID_BYTES];
+
+    // Received values closer than amount (or amount percent) to the stored value are ignored, so they are neither stored nor reported.
+    void setDeadband(float amount, bool percent = false)
+    {
+        if (type != STRING)
+        {
+            deadband = amount;
+            deadbandPercent = percent;
+        }
+    }
+
+    void setChangeCallback(ValueChangeCallback callback)
+    {
+        changeCallback = callback;
+    }
+
+    // Numeric handlers only, counters being recorded as their rate per second.
+    void setHistory(SNMPHistory *samples)
+    {
+        history = samples;
+    }
+};
+
+// One row of a handler table registered with SNMPManager::addHandlers(). Tables can be const, and on AVR placed in PROGMEM.
+struct SNMPHandlerEntry
+{
+    uint8_t ip[4];
+    const char *oid; // Dotted, in PROGMEM too when the table is
+    ASN_TYPE type;
+    void *value;
+    bool isFloat; // INTEGER stored in a float, divided by 10
+};
+
+// Handlers are allocated a block at a time, so they stay in place (callers keep pointers to them) and sit next to each other in memory.
+// The handlers follow the block header in the same allocation.
+struct SNMPHandlerBlock
+{
+    SNMPHandlerBlock *next;
+    uint16_t count;
+    uint16_t capacity;
+    uint16_t firstSlot; // Slot of the first handler
+    ValueCallback *handlers()
+    {
+        return (ValueCallback *)(this + 1);
+    }
+};
+
+// Blocks of removed agents are kept here until freeSpare(), rather than freed or handed to another agent, so a ValueCallback
+// pointer still held by a request never points into freed memory or at another agent's OID. It just refers to a removed handler.
+class SNMPHandlerPool
+{
+public:
+    static SNMPHandlerBlock *acquire(uint16_t capacity)
+    {
+        SNMPHandlerBlock *block = (SNMPHandlerBlock *)malloc(sizeof(SNMPHandlerBlock) + capacity * sizeof(ValueCallback));
+        if (block)
+        {
+            block->count = 0;
+            block->capacity = capacity;
+        }
+        return block;
+    }
+
+    static void release(SNMPHandlerBlock *block)
+    {
+        ValueCallback *handlers = block->handlers();
+        for (uint16_t i = 0; i < block->count; i++)
+        {
+            handlers[i].agent = 0;
+            handlers[i].oidLength = 0;
+        }
+        block->next = spareBlocks();
+        spareBlocks() = block;
+    }
+
+    // Returns the spare blocks to the heap. Only safe once no request holds a pointer to a handler of a removed agent.
+    static void freeSpare()
+    {
+        while (spareBlocks())
+        {
+            SNMPHandlerBlock *block = spareBlocks();
+            spareBlocks() = block->next;
+            free(block);
+        }
+    }
+
+private:
+    static SNMPHandlerBlock *&spareBlocks()
+    {
+        static SNMPHandlerBlock *spare = 0;
+        return spare;
+    }
+};
+
+// The handlers of the OIDs in a request, in order.
+class SNMPOIDList
+{
+public:
+    ~SNMPOIDList()
+    {
+        free(_oids);
+    };
+
+    bool add(ValueCallback *callback)
+    {
+        if (!callback)
+        {
+            return false;
+        }
+        if (_count == _capacity)
+        {
+            int capacity = _capacity ? _capacity * 2 : 4;
+            ValueCallback **grown = (ValueCallback **)realloc(_oids, capacity * sizeof(ValueCallback *));
+            if (!grown)
+            {
+                return false;
+            }
+            _oids = grown;
+            _capacity = capacity;
+        }
+        _oids[_count++] = callback;
+        return true;
+    }
+
+    bool remove(ValueCallback *callback)
+    {
+        for (int i = 0; i < _count; i++)
+        {
+            if (_oids[i] == callback)
+            {
+                memmove(&_oids[i], &_oids[i + 1], (_count - i - 1) * sizeof(ValueCallback *));
+                _count--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Drops handlers removed from the manager since they were added, returns how many
+    int dropRemoved()
+    {
+        int kept = 0;
+        for (int i = 0; i < _count; i++)
+        {
+            if (_oids[i]->agent)
+            {
+                _oids[kept++] = _oids[i];
+            }
+        }
+        int dropped = _count - kept;
+        _count = kept;
+        return dropped;
+    }
+
+    void clear()
+    {
+        _count = 0;
+    }
+
+    int count()
+    {
+        return _count;
+    }
+
+    ValueCallback *operator[](int index)
+    {
+        return _oids[index];
+    }
+
+private:
+    ValueCallback **_oids = 0;
+    int _count = 0;
+    int _capacity = 0;
+};
+
+// Node of an agent's OID trie, one per BER encoded byte of the handlers' OIDs. Nodes are held in one array and linked by index.
+struct SNMPTrieNode
+{
+    ValueCallback *handler; // Handler of the OID ending at this node
+    uint16_t child;         // First child, 0 for none as the root is never a child
+    uint16_t sibling;
+    unsigned char label; // OID byte leading to this node
+};
+
+// Per agent settings, so one manager can talk to agents using different versions, communities and ports.
+class SNMPAgent
+{
+public:
+    SNMPAgent(IPAddress agentIP) : ip(agentIP){};
+    ~SNMPAgent()
+    {
+        while (_handlers)
+        {
+            SNMPHandlerBlock *block = _handlers;
+            _handlers = block->next;
+            SNMPHandlerPool::release(block);
+        }
+        free(_trie);
+        free(_dirty);
+    };
+    IPAddress ip;
+    short version = SNMP_VERSION_UNSET; // SNMP Version 1 = 0, SNMP Version 2 = 1, SNMP Version 3 = 3
+    const char *community = 0;
+    uint16_t port = 161;
+    SNMPv3Engine *engine = 0; // Only for SNMPv3
+    SNMPAgent *next = 0;      // Next agent in the same hash bucket
+    uint8_t window = SNMP_AGENT_INITIAL_WINDOW; // Tracked requests allowed awaiting a response
+    uint8_t inFlight = 0;                       // Tracked requests awaiting a response
+    uint8_t windowAnswered = 0;                 // Responses since the window last grew
+    SNMPAgentState state = SNMP_AGENT_UP;
+    uint8_t timeouts = 0; // Consecutive timeouts
+    unsigned long probeInterval = SNMP_AGENT_PROBE_INTERVAL;
+    unsigned long lastTimeout = 0;
+    uint8_t maxRepetitions = 0; // Largest GetBulk max-repetitions whose response fits, learned from responses. 0 until known.
+    uint32_t generation = 0;    // Manager generation in which a handler value last changed
+
+    // Whether a tracked request may be sent now. Agents that are down are only sent one request at a time,
+    // once the probe interval has passed since the last timeout.
+    bool canSend()
+    {
+        if (state == SNMP_AGENT_DOWN)
+        {
+            return !inFlight && millis() - lastTimeout >= probeInterval;
+        }
+        return inFlight < window;
+    }
+
+    // The window grows by one each time a window's worth of requests have been answered, and halves on a timeout,
+    // so agents that drop requests under load get few at a time while capable ones get many.
+    // Both return true if the agent's state changed.
+    bool requestAnswered()
+    {
+        if (window < SNMP_AGENT_MAX_WINDOW && ++windowAnswered >= window)
+        {
+            window++;
+            windowAnswered = 0;
+        }
+        timeouts = 0;
+        probeInterval = SNMP_AGENT_PROBE_INTERVAL;
+        if (state == SNMP_AGENT_UP)
+        {
+            return false;
+        }
+        state = SNMP_AGENT_UP;
+        return true;
+    }
+    bool requestTimedOut()
+    {
+        window = window > 1 ? window / 2 : 1;
+        windowAnswered = 0;
+        lastTimeout = millis();
+        if (timeouts < 0xFF)
+        {
+            timeouts++;
+        }
+        if (state == SNMP_AGENT_DOWN)
+        {
+            // A failed probe, wait twice as long for the next
+            probeInterval = probeInterval * 2 < SNMP_AGENT_MAX_PROBE_INTERVAL ? probeInterval * 2 : SNMP_AGENT_MAX_PROBE_INTERVAL;
+            return false;
+        }
+        SNMPAgentState previous = state;
+        state = timeouts >= SNMP_AGENT_DOWN_TIMEOUTS ? SNMP_AGENT_DOWN : SNMP_AGENT_SUSPECT;
+        return state != previous;
+    }
+
+    // Returns the handler for the OID, added if there isn't one yet, or 0 if the OID is invalid or longer than SNMP_MAX_OID_BYTES.
+    // An existing handler is given the new type and destination.
+    ValueCallback *addHandler(const char *oid, ASN_TYPE type, void *value);
+    ValueCallback *addPrefixHandler(const char *oid, PrefixValueCallback callback);
+    // The handler's slot is reused by the handlers added to this agent after the next reclaimRemoved().
+    void removeHandler(ValueCallback *callback);
+    // Lets the slots of the handlers removed so far be reused. Only safe once nothing holds a pointer to one of them.
+    void reclaimRemoved();
+    // Finds the handler registered for exactly this OID. When prefixLength is given, finds the handler a response with this OID
+    // is dispatched to instead: a handler for exactly this OID, otherwise the prefix handler with the longest OID above it,
+    // setting prefixLength to the length of the prefix.
+    ValueCallback *findHandler(const unsigned char *oid, uint8_t oidLength, uint8_t *prefixLength = 0);
+    int handlerCount()
+    {
+        return _handlerCount;
+    }
+    // Records that the handler's value changed in the generation, setting its bit in the dirty bitmap.
+    void markChanged(ValueCallback *callback, uint32_t changed);
+    // Calls the callback for each handler changed after since, returning how many. The dirty bitmap holds the handlers changed
+    // since the previous call, so only their bits are looked at when since is no older than that, otherwise every handler is.
+    // The bitmap then starts again from now.
+    int forEachChanged(uint32_t since, uint32_t now, ValueChangeCallback callback);
+    // Goes through the handlers whose value changed in the generation, leaving the dirty bitmap as it is. Pass 0 for the first
+    // and then the handler returned, until it returns 0.
+    ValueCallback *nextChanged(ValueCallback *previous, uint32_t changed);
+    // The next block allocated will have room for this many more handlers, so a table is stored in one allocation.
+    void reserveHandlers(int count)
+    {
+        _reserved += count;
+    }
+
+private:
+    SNMPHandlerBlock *_handlers = 0; // Newest block first, it is the only one with room
+    ValueCallback *_free = 0;        // Removed handlers whose slots can be reused, linked through their value
+    ValueCallback *_removed = 0;     // Removed handlers which may still be held, linked the same way
+    int _handlerCount = 0;
+    int _reserved = 0;
+    uint16_t _slots = 0;     // Slots of all the blocks
+    uint32_t *_dirty = 0;    // Bit per slot, set when the handler's value changes
+    uint16_t _dirtyWords = 0;
+    uint32_t _dirtyFrom = 0; // Generation the bitmap has been collecting since
+    bool _dirtyLost = false; // The bitmap couldn't grow, so it can't be relied on
+    // Handlers added are inserted as they are registered, the trie is rebuilt on the first lookup after a removal
+    SNMPTrieNode *_trie = 0;
+    uint16_t _trieSize = 0;
+    uint16_t _trieCapacity = 0;
+    bool _trieValid = false;
+    ValueCallback *addHandler(const char *oid, ASN_TYPE type, void *value, bool prefix);
+    bool buildTrie();
+    bool trieInsert(ValueCallback *callback);
+    ValueCallback *findHandlerLinear(const unsigned char *oid, uint8_t oidLength, uint8_t *prefixLength);
+};
+
+ValueCallback *SNMPAgent::addHandler(const char *oid, ASN_TYPE type, void *value)
+{
+    return addHandler(oid, type, value, false);
+}
+
+ValueCallback *SNMPAgent::addHandler(const char *oid, ASN_TYPE type, void *value, bool prefix)
+{
+    unsigned char encoded[SNMP_MAX_OID_BYTES];
+    int length = berEncodeOID(oid, encoded, SNMP_MAX_OID_BYTES);
+    if (!length)
+    {
+        Serial.print(F("OID invalid or too long for a handler: "));
+        Serial.println(oid);
+        if (_reserved)
+        {
+            _reserved--;
+        }
+        return 0;
+    }
+    // Registering an OID again returns its existing handler, so repeated registration doesn't grow the agent
+    ValueCallback *callback = findHandler(encoded, length);
+    if (callback)
+    {
+        if (_reserved)
+        {
+            _reserved--;
+        }
+        if (callback->isPrefix != prefix)
+        {
+            // Only one handler is reachable per OID, so a prefix handler and a value handler can't share one
+            Serial.print(callback->isPrefix ? F("OID already has a prefix handler: ") : F("OID already has a value handler: "));
+            Serial.println(oid);
+            return 0;
+        }
+        if (callback->value != value || callback->type != type)
+        {
+            callback->value = value;
+            callback->type = type;
+            callback->isFloat = false;
+            callback->hasValue = false;
+        }
+        return callback;
+    }
+    if (_free)
+    {
+        callback = _free;
+        _free = (ValueCallback *)callback->value;
+    }
+    else
+    {
+        if (!_handlers || _handlers->count == _handlers->capacity)
+        {
+            SNMPHandlerBlock *block = SNMPHandlerPool::acquire(_reserved > SNMP_HANDLER_BLOCK_SIZE ? _reserved : SNMP_HANDLER_BLOCK_SIZE);
+            if (!block)
+            {
+                return 0;
+            }
+            block->next = _handlers;
+            block->firstSlot = _slots;
+            _slots += block->capacity;
+            _handlers = block;
+        }
+        callback = &_handlers->handlers()[_handlers->count];
+        callback->slot = _handlers->firstSlot + _handlers->count++;
+    }
+    if (_reserved)
+    {
+        _reserved--;
+    }
+    callback->value = value;
+    callback->agent = this;
+    callback->changeCallback = 0;
+    callback->history = 0;
+    callback->deadband = 0;
+    callback->type = type;
+    callback->isFloat = false;
+    callback->isPrefix = prefix;
+    callback->deadbandPercent = false;
+    callback->hasValue = false;
+    callback->generation = 0;
+    callback->alarmCondition = 0;
+    callback->oidLength = length;
+    memcpy(callback->oid, encoded, length);
+    _handlerCount++;
+    if (_trieValid && !trieInsert(callback))
+    {
+        _trieValid = false;
+    }
+    return callback;
+}
+
+ValueCallback *SNMPAgent::addPrefixHandler(const char *oid, PrefixValueCallback callback)
+{
+    ValueCallback *handler = addHandler(oid, NULLTYPE, 0, true);
+    if (handler)
+    {
+        handler->prefixCallback = callback;
+    }
+    return handler;
+}
+
+void SNMPAgent::removeHandler(ValueCallback *callback)
+{
+    // A zero length never matches a response, so the slot can stay where it is until reused
+    callback->agent = 0;
+    callback->oidLength = 0;
+    callback->value = _removed;
+    _removed = callback;
+    _handlerCount--;
+    _trieValid = false;
+}
+
+void SNMPAgent::reclaimRemoved()
+{
+    while (_removed)
+    {
+        ValueCallback *callback = _removed;
+        _removed = (ValueCallback *)callback->value;
+        callback->value = _free;
+        _free = callback;
+    }
+}
+
+void SNMPAgent::markChanged(ValueCallback *callback, uint32_t changed)
+{
+    callback->generation = changed;
+    generation = changed;
+    uint16_t word = callback->slot / 32;
+    if (word >= _dirtyWords)
+    {
+        uint16_t words = (_slots + 31) / 32;
+        uint32_t *grown = (uint32_t *)realloc(_dirty, words * sizeof(uint32_t));
+        if (!grown)
+        {
+            _dirtyLost = true;
+            return;
+        }
+        memset(grown + _dirtyWords, 0, (words - _dirtyWords) * sizeof(uint32_t));
+        _dirty = grown;
+        _dirtyWords = words;
+    }
+    _dirty[word] |= 1UL << (callback->slot % 32);
+}
+
+int SNMPAgent::forEachChanged(uint32_t since, uint32_t now, ValueChangeCallback callback)
+{
+    if (generation <= since)
+    {
+        return 0;
+    }
+    bool useBitmap = since >= _dirtyFrom && !_dirtyLost;
+    int count = 0;
+    for (SNMPHandlerBlock *block = _handlers; block; block = block->next)
+    {
+        ValueCallback *handlers = block->handlers();
+        for (uint16_t i = 0; i < block->count; i++)
+        {
+            uint16_t slot = block->firstSlot + i;
+            if (useBitmap)
+            {
+                uint32_t word = slot / 32 < _dirtyWords ? _dirty[slot / 32] : 0;
+                if (!word)
+                {
+                    i += 31 - slot % 32; // Nothing changed in the rest of the word
+                    continue;
+                }
+                if (!(word & (1UL << (slot % 32))))
+                {
+                    continue;
+                }
+            }
+            ValueCallback *handler = &handlers[i];
+            if (handler->agent == this && handler->generation > since)
+            {
+                callback(ip, handler);
+                count++;
+            }
+        }
+    }
+    if (_dirty)
+    {
+        memset(_dirty, 0, _dirtyWords * sizeof(uint32_t));
+    }
+    _dirtyFrom = now;
+    _dirtyLost = false;
+    return count;
+}
+
+ValueCallback *SNMPAgent::nextChanged(ValueCallback *previous, uint32_t changed)
+{
+    bool found = !previous;
+    for (SNMPHandlerBlock *block = _handlers; block; block = block->next)
+    {
+        ValueCallback *handlers = block->handlers();
+        uint16_t i = 0;
+        if (!found)
+        {
+            if (previous < handlers || previous >= handlers + block->count)
+            {
+                continue;
+            }
+            found = true;
+            i = previous - handlers + 1;
+        }
+        for (; i < block->count; i++)
+        {
+            if (handlers[i].agent == this && handlers[i].generation == changed)
+            {
+                return &handlers[i];
+            }
+        }
+    }
+    return 0;
+}
+
+ValueCallback *SNMPAgent::findHandler(const unsigned char *oid, uint8_t oidLength, uint8_t *prefixLength)
+{
+    if (!_trieValid && !buildTrie())
+    {
+        return findHandlerLinear(oid, oidLength, prefixLength);
+    }
+    // One descent, remembering the deepest prefix handler passed on the way
+    ValueCallback *prefix = 0;
+    uint8_t prefixDepth = 0;
+    uint16_t node = 0;
+    for (uint8_t i = 0; i < oidLength; i++)
+    {
+        node = _trie[node].child;
+        while (node && _trie[node].label != oid[i])
+        {
+            node = _trie[node].sibling;
+        }
+        if (!node)
+        {
+            break;
+        }
+        ValueCallback *handler = _trie[node].handler;
+        if (!handler)
+        {
+            continue;
+        }
+        if (i == oidLength - 1)
+        {
+            if (!prefixLength || !handler->isPrefix)
+            {
+                return handler;
+            }
+        }
+        else if (handler->isPrefix)
+        {
+            prefix = handler;
+            prefixDepth = i + 1;
+        }
+    }
+    if (prefixLength && prefix)
+    {
+        *prefixLength = prefixDepth;
+        return prefix;
+    }
+    return 0;
+}
+
+ValueCallback *SNMPAgent::findHandlerLinear(const unsigned char *oid, uint8_t oidLength, uint8_t *prefixLength)
+{
+    // Used when there isn't the memory for the trie
+    ValueCallback *prefix = 0;
+    for (SNMPHandlerBlock *block = _handlers; block; block = block->next)
+    {
+        ValueCallback *handlers = block->handlers();
+        for (uint16_t i = 0; i < block->count; i++)
+        {
+            ValueCallback *callback = &handlers[i];
+            if (callback->oidLength == oidLength && memcmp(callback->oid, oid, oidLength) == 0 && (!prefixLength || !callback->isPrefix))
+            {
+                return callback;
+            }
+            if (prefixLength && callback->isPrefix && callback->oidLength && callback->oidLength < oidLength && (!prefix || callback->oidLength > prefix->oidLength) && memcmp(callback->oid, oid, callback->oidLength) == 0)
+            {
+                prefix = callback;
+            }
+        }
+    }
+    if (prefix)
+    {
+        *prefixLength = prefix->oidLength;
+    }
+    return prefix;
+}
+
+bool SNMPAgent::buildTrie()
+{
+    _trieSize = 0;
+    if (!_trieCapacity)
+    {
+        _trie = (SNMPTrieNode *)malloc(sizeof(SNMPTrieNode) * SNMP_HANDLER_BLOCK_SIZE);
+        if (!_trie)
+        {
+            return false;
+        }
+        _trieCapacity = SNMP_HANDLER_BLOCK_SIZE;
+    }
+    _trie[_trieSize++] = {0, 0, 0, 0};
+    for (SNMPHandlerBlock *block = _handlers; block; block = block->next)
+    {
+        ValueCallback *handlers = block->handlers();
+        for (uint16_t i = 0; i < block->count; i++)
+        {
+            if (handlers[i].agent == this && !trieInsert(&handlers[i]))
+            {
+                return false;
+            }
+        }
+    }
+    _trieValid = true;
+    return true;
+}
+
+bool SNMPAgent::trieInsert(ValueCallback *callback)
+{
+    uint16_t node = 0;
+    for (uint8_t i = 0; i < callback->oidLength; i++)
+    {
+        uint16_t next = _trie[node].child;
+        while (next && _trie[next].label != callback->oid[i])
+        {
+            next = _trie[next].sibling;
+        }
+        if (!next)
+        {
+            if (_trieSize == _trieCapacity)
+            {
+                if (_trieCapacity > 0x7FFF)
+                {
+                    return false;
+                }
+                SNMPTrieNode *grown = (SNMPTrieNode *)realloc(_trie, sizeof(SNMPTrieNode) * _trieCapacity * 2);
+                if (!grown)
+                {
+                    return false;
+                }
+                _trie = grown;
+                _trieCapacity *= 2;
+            }
+            next = _trieSize++;
+            _trie[next] = {0, 0, _trie[node].child, callback->oid[i]};
+            _trie[node].child = next;
+        }
+        node = next;
+    }
+    if (!_trie[node].handler)
+    {
+        _trie[node].handler = callback;
+    }
+    return true;
+}
+
+class SNMPAgentTable
+{
+public:
+    SNMPAgentTable()
+    {
+        memset(_buckets, 0, sizeof(_buckets));
+    };
+    ~SNMPAgentTable()
+    {
+        for (int i = 0; i < SNMP_AGENT_HASH_BUCKETS; i++)
+        {
+            while (_buckets[i])
+            {
+                SNMPAgent *agent = _buckets[i];
+                _buckets[i] = agent->next;
+                delete agent;
+            }
+        }
+    };
+
+    // Returns the existing agent for the address if there is one, otherwise a new agent with default settings.
+    SNMPAgent *add(IPAddress ip)
+    {
+        SNMPAgent *agent = find(ip);
+        if (!agent)
+        {
+            agent = new SNMPAgent(ip);
+            uint8_t bucket = hash(ip);
+            agent->next = _buckets[bucket];
+            _buckets[bucket] = agent;
+            _count++;
+        }
+        return agent;
+    }
+
+    bool remove(IPAddress ip)
+    {
+        for (SNMPAgent **agent = &_buckets[hash(ip)]; *agent; agent = &(*agent)->next)
+        {
+            if ((*agent)->ip == ip)
+            {
+                SNMPAgent *removed = *agent;
+                *agent = removed->next;
+                delete removed;
+                _count--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    SNMPAgent *find(IPAddress ip)
+    {
+        for (SNMPAgent *agent = _buckets[hash(ip)]; agent; agent = agent->next)
+        {
+            if (agent->ip == ip)
+            {
+                return agent;
+            }
+        }
+        return 0;
+    }
+
+    int count()
+    {
+        return _count;
+    }
+
+    void reclaimRemoved()
+    {
+        for (int i = 0; i < SNMP_AGENT_HASH_BUCKETS; i++)
+        {
+            for (SNMPAgent *agent = _buckets[i]; agent; agent = agent->next)
+            {
+                agent->reclaimRemoved();
+            }
+        }
+    }
+
+    int forEachChanged(uint32_t since, uint32_t now, ValueChangeCallback callback)
+    {
+        int count = 0;
+        for (int i = 0; i < SNMP_AGENT_HASH_BUCKETS; i++)
+        {
+            for (SNMPAgent *agent = _buckets[i]; agent; agent = agent->next)
+            {
+                count += agent->forEachChanged(since, now, callback);
+            }
+        }
+        return count;
+    }
+
+private:
+    SNMPAgent *_buckets[SNMP_AGENT_HASH_BUCKETS];
+    int _count = 0;
+
+    static uint8_t hash(IPAddress ip)
+    {
+        // Agents are usually on the same subnet, so the low octets carry most of the variation
+        return (ip[3] ^ (ip[2] * 7) ^ (ip[1] * 31)) & (SNMP_AGENT_HASH_BUCKETS - 1);
+    }
+};
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef SNMPAlarms_h
+#define SNMPAlarms_h
+
+#ifndef SNMP_ALARM_RULES
+#define SNMP_ALARM_RULES 8 // Alarms one SNMPAlarms holds
+#endif
+
+#ifndef SNMP_ALARM_CONDITIONS
+#define SNMP_ALARM_CONDITIONS 16 // Conditions across all the alarms of one SNMPAlarms, at most 255
+#endif
+
+enum SNMPAlarmTest
+{
+    SNMP_ALARM_ABOVE,      // Value greater than the threshold, until it is back to the threshold less the hysteresis
+    SNMP_ALARM_BELOW,      // Value less than the threshold, until it is back to the threshold plus the hysteresis
+    SNMP_ALARM_EQUAL,      // Value equal to the threshold, for states such as upsOutputSource
+    SNMP_ALARM_NOT_EQUAL,  // Value not equal to the threshold
+    SNMP_ALARM_RISING,     // Change per second above the threshold, with the same hysteresis as SNMP_ALARM_ABOVE
+    SNMP_ALARM_FALLING,    // Change per second below the threshold, with the same hysteresis as SNMP_ALARM_BELOW
+};
+
+// Called when an alarm becomes active, all its conditions being met, or stops being active. handler and value are those of the
+// value that caused it.
+typedef void (*AlarmCallback)(int alarm, bool active, ValueCallback *handler, float value);
+
+// One test of one handler's value
+struct SNMPAlarmCondition
+{
+    ValueCallback *handler;
+    float threshold;
+    float hysteresis;
+    union
+    {
+        float last;         // Previous value, for the rate of change
+        uint64_t lastCount; // Previous count of a counter, kept whole as a float can't resolve the change in a large count
+    };
+    unsigned long lastTime;
+    SNMPAlarmTest test;
+    uint8_t alarm;
+    uint8_t next; // Next condition on the same handler, plus one, 0 for none
+    bool met;
+    bool hasLast;
+};
+
+struct SNMPAlarmRule
+{
+    const char *name;
+    AlarmCallback callback;
+    uint8_t conditions;
+    uint8_t met; // Conditions currently met
+    bool active;
+};
+
+// Alarms raised when every one of their conditions is met, each condition testing the value of one handler. The alarms and their
+// conditions are kept in fixed arrays, and each handler links to the conditions on its value, so a value received only tests its
+// own conditions and an alarm is only looked at when one of its conditions changes. Nothing is allocated and nothing is done in
+// loop() besides receiving the values. Given to the manager with SNMPManager::setAlarms(), one SNMPAlarms per manager.
+class SNMPAlarms
+{
+public:
+    // Returns the alarm's number, passed to its callback, or -1 if there are already SNMP_ALARM_RULES alarms
+    int addAlarm(const char *name, AlarmCallback callback);
+    // Adds a condition to the alarm added last, all of which must be met for it to be active. Numeric handlers only: INTEGER
+    // handlers are tested as stored (divided by 10 for float handlers), counters by their count. Returns false if there are
+    // already SNMP_ALARM_CONDITIONS conditions.
+    bool addCondition(ValueCallback *handler, SNMPAlarmTest test, float threshold, float hysteresis = 0);
+
+    int alarmCount()
+    {
+        return _alarmCount;
+    }
+    const char *name(int alarm)
+    {
+        return alarm >= 0 && alarm < _alarmCount ? _alarms[alarm].name : 0;
+    }
+    bool isActive(int alarm)
+    {
+        return alarm >= 0 && alarm < _alarmCount && _alarms[alarm].active;
+    }
+
+    // Called by the manager with each value received for a handler with conditions, count being the value of a counter
+    void evaluate(ValueCallback *handler, float value, uint64_t count, unsigned long time);
+
+private:
+    SNMPAlarmRule _alarms[SNMP_ALARM_RULES];
+    SNMPAlarmCondition _conditions[SNMP_ALARM_CONDITIONS];
+    uint8_t _alarmCount = 0;
+    uint8_t _conditionCount = 0;
+
+    bool test(SNMPAlarmCondition *condition, float value, uint64_t count, unsigned long time);
+};
+
+#if SNMP_ALARM_CONDITIONS > 255
+#error SNMP_ALARM_CONDITIONS must be at most 255
+#endif
+
+int SNMPAlarms::addAlarm(const char *name, AlarmCallback callback)
+{
+    if (_alarmCount >= SNMP_ALARM_RULES)
+    {
+        return -1;
+    }
+    SNMPAlarmRule *alarm = &_alarms[_alarmCount];
+    alarm->name = name;
+    alarm->callback = callback;
+    alarm->conditions = 0;
+    alarm->met = 0;
+    alarm->active = false;
+    return _alarmCount++;
+}
+
+bool SNMPAlarms::addCondition(ValueCallback *handler, SNMPAlarmTest test, float threshold, float hysteresis)
+{
+    if (!_alarmCount || _conditionCount >= SNMP_ALARM_CONDITIONS || !handler || handler->type == STRING || handler->isPrefix)
+    {
+        return false;
+    }
+    SNMPAlarmCondition *condition = &_conditions[_conditionCount];
+    condition->handler = handler;
+    condition->threshold = threshold;
+    condition->hysteresis = hysteresis;
+    condition->test = test;
+    condition->alarm = _alarmCount - 1;
+    condition->met = false;
+    condition->hasLast = false;
+    // Linked in front of the handler's other conditions
+    condition->next = handler->alarmCondition;
+    handler->alarmCondition = ++_conditionCount;
+    _alarms[_alarmCount - 1].conditions++;
+    return true;
+}
+
+void SNMPAlarms::evaluate(ValueCallback *handler, float value, uint64_t count, unsigned long time)
+{
+    for (uint8_t next = handler->alarmCondition; next; next = _conditions[next - 1].next)
+    {
+        SNMPAlarmCondition *condition = &_conditions[next - 1];
+        bool met = test(condition, value, count, time);
+        if (met == condition->met)
+        {
+            continue;
+        }
+        condition->met = met;
+        SNMPAlarmRule *alarm = &_alarms[condition->alarm];
+        alarm->met += met ? 1 : -1;
+        bool active = alarm->met == alarm->conditions;
+        if (active != alarm->active)
+        {
+            alarm->active = active;
+#ifdef DEBUG
+            Serial.print(F("[DEBUG] SNMPAlarms: "));
+            Serial.print(alarm->name);
+            Serial.println(active ? F(" active") : F(" cleared"));
+#endif
+            if (alarm->callback)
+            {
+                alarm->callback(condition->alarm, active, handler, value);
+            }
+        }
+    }
+}
+
+bool SNMPAlarms::test(SNMPAlarmCondition *condition, float value, uint64_t count, unsigned long time)
+{
+    float tested = value;
+    if (condition->test == SNMP_ALARM_RISING || condition->test == SNMP_ALARM_FALLING)
+    {
+        float difference;
+        bool restarted = false;
+        ASN_TYPE type = condition->handler->type;
+        if (type == COUNTER32 || type == COUNTER64)
+        {
+            // The difference is taken between whole counts, a 32 bit counter across a wrap
+            difference = type == COUNTER32 ? (float)(uint32_t)(count - condition->lastCount) : (float)(count - condition->lastCount);
+            restarted = type == COUNTER64 && count < condition->lastCount; // The agent restarted, the rate is found again from this count
+            condition->lastCount = count;
+        }
+        else
+        {
+            difference = value - condition->last;
+            condition->last = value;
+        }
+        bool known = condition->hasLast && !restarted && time != condition->lastTime;
+        if (known)
+        {
+            tested = difference * 1000.0f / (time - condition->lastTime);
+        }
+        condition->lastTime = time;
+        condition->hasLast = true;
+        if (!known)
+        {
+            return condition->met;
+        }
+    }
+    switch (condition->test)
+    {
+    case SNMP_ALARM_ABOVE:
+    case SNMP_ALARM_RISING:
+        return condition->met ? tested > condition->threshold - condition->hysteresis : tested > condition->threshold;
+    case SNMP_ALARM_BELOW:
+    case SNMP_ALARM_FALLING:
+        return condition->met ? tested < condition->threshold + condition->hysteresis : tested < condition->threshold;
+    case SNMP_ALARM_EQUAL:
+        return tested == condition->threshold;
+    case SNMP_ALARM_NOT_EQUAL:
+        return tested != condition->threshold;
+    }
+    return false;
+}
+
+#endif
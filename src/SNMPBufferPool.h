@@ -0,0 +1,117 @@
+#ifndef SNMPBufferPool_h
+#define SNMPBufferPool_h
+
+#ifndef SNMP_SMALL_BUFFER_LENGTH
+#define SNMP_SMALL_BUFFER_LENGTH 128 // Enough for a GetRequest of a few OIDs, or an SNMPv3 discovery message.
+#endif
+
+#ifndef SNMP_SMALL_BUFFER_COUNT
+#define SNMP_SMALL_BUFFER_COUNT 2
+#endif
+
+#ifndef SNMP_LARGE_BUFFER_COUNT
+#define SNMP_LARGE_BUFFER_COUNT 2 // One for the packet being received, one for a request sent while handling it.
+#endif
+
+// Large buffers hold a full packet, plus the room an SNMPv3 message is wrapped into in place.
+#define SNMP_LARGE_BUFFER_LENGTH (SNMP_PACKET_LENGTH + SNMP_V3_HEADER_RESERVE)
+
+#define SNMP_BUFFER_POOL_BYTES (SNMP_SMALL_BUFFER_COUNT * SNMP_SMALL_BUFFER_LENGTH + SNMP_LARGE_BUFFER_COUNT * SNMP_LARGE_BUFFER_LENGTH)
+
+// Add #define SNMP_MEMORY_BUDGET <bytes> to fail the build if the pool is larger,
+// or #define SNMP_REPORT_MEMORY to have its size printed while compiling.
+#ifdef SNMP_MEMORY_BUDGET
+static_assert(SNMP_BUFFER_POOL_BYTES <= SNMP_MEMORY_BUDGET, "SNMP buffer pool is larger than SNMP_MEMORY_BUDGET, reduce SNMP_PACKET_LENGTH or the buffer counts");
+#endif
+#ifdef SNMP_REPORT_MEMORY
+#define SNMP_STRINGIFY(x) #x
+#define SNMP_EXPAND_STRINGIFY(x) SNMP_STRINGIFY(x)
+#pragma message("SNMP buffer pool bytes: " SNMP_EXPAND_STRINGIFY(SNMP_BUFFER_POOL_BYTES))
+#endif
+
+// Packet buffers shared by every request and the manager, allocated once rather than on the stack for each packet.
+class SNMPBufferPool
+{
+public:
+    // Lends the smallest free buffer of at least length bytes, or returns 0 if none is free.
+    static unsigned char *acquire(unsigned int length)
+    {
+        SNMPBufferPool &pool = instance();
+        if (length <= SNMP_SMALL_BUFFER_LENGTH)
+        {
+            for (uint8_t i = 0; i < SNMP_SMALL_BUFFER_COUNT; i++)
+            {
+                if (!pool._smallInUse[i])
+                {
+                    pool._smallInUse[i] = true;
+                    return pool._small[i];
+                }
+            }
+        }
+        if (length <= SNMP_LARGE_BUFFER_LENGTH)
+        {
+            for (uint8_t i = 0; i < SNMP_LARGE_BUFFER_COUNT; i++)
+            {
+                if (!pool._largeInUse[i])
+                {
+                    pool._largeInUse[i] = true;
+                    return pool._large[i];
+                }
+            }
+        }
+        Serial.print(F("No free SNMP buffer for length: "));
+        Serial.println(length);
+        return 0;
+    }
+
+    static void release(unsigned char *buf)
+    {
+        SNMPBufferPool &pool = instance();
+        for (uint8_t i = 0; i < SNMP_SMALL_BUFFER_COUNT; i++)
+        {
+            if (buf == pool._small[i])
+            {
+                pool._smallInUse[i] = false;
+                return;
+            }
+        }
+        for (uint8_t i = 0; i < SNMP_LARGE_BUFFER_COUNT; i++)
+        {
+            if (buf == pool._large[i])
+            {
+                pool._largeInUse[i] = false;
+                return;
+            }
+        }
+    }
+
+private:
+    unsigned char _small[SNMP_SMALL_BUFFER_COUNT][SNMP_SMALL_BUFFER_LENGTH];
+    unsigned char _large[SNMP_LARGE_BUFFER_COUNT][SNMP_LARGE_BUFFER_LENGTH];
+    bool _smallInUse[SNMP_SMALL_BUFFER_COUNT] = {};
+    bool _largeInUse[SNMP_LARGE_BUFFER_COUNT] = {};
+
+    static SNMPBufferPool &instance()
+    {
+        static SNMPBufferPool pool;
+        return pool;
+    }
+};
+
+// Borrows a buffer from the pool for as long as it is in scope.
+class SNMPBuffer
+{
+public:
+    SNMPBuffer(unsigned int length) : data(SNMPBufferPool::acquire(length)), size(data ? length : 0){};
+    ~SNMPBuffer()
+    {
+        if (data)
+        {
+            SNMPBufferPool::release(data);
+        }
+    };
+    unsigned char *const data;
+    const unsigned int size;
+};
+
+#endif
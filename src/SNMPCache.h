@@ -0,0 +1,293 @@
+#ifndef SNMPCache_h
+#define SNMPCache_h
+
+#ifndef SNMP_CACHE_ENTRIES
+#define SNMP_CACHE_ENTRIES 32 // Handlers one SNMPCache keeps track of, the least recently fetched being replaced when full
+#endif
+
+#ifndef SNMP_CACHE_REQUEST_OIDS
+#define SNMP_CACHE_REQUEST_OIDS 8 // Most OIDs fetched by one GetRequest
+#endif
+
+enum SNMPCacheState
+{
+    SNMP_CACHE_IDLE,
+    SNMP_CACHE_WANTED,    // Requested, waiting for loop() to send it
+    SNMP_CACHE_IN_FLIGHT, // Sent, waiting for the response
+};
+
+struct SNMPCacheEntry
+{
+    ValueCallback *handler; // 0 when unused
+    unsigned long fetchedAt;
+    unsigned long requestID;
+    SNMPCacheState state;
+    bool fresh; // Fetched without an error, at fetchedAt
+};
+
+// Sits in front of GetRequests for handlers read by several parts of a sketch. A value fetched less than the TTL ago is served
+// from the handler's destination without a request, and a handler requested again while it is already being fetched joins
+// that request rather than sending another. The handlers wanted from each agent are fetched together by loop().
+class SNMPCache : public SNMPRequestOwner
+{
+public:
+    SNMPCache(const char *community, short version, unsigned long ttl) : _get(community, version), _ttl(ttl)
+    {
+        _nextRequestID = random(0x7FFF) + 1;
+        memset(_entries, 0, sizeof(_entries));
+    };
+    ~SNMPCache()
+    {
+        if (_manager)
+        {
+            _manager->cancelRequests(this);
+        }
+    };
+
+    void setUDP(UDP *udp)
+    {
+        _get.setUDP(udp);
+    }
+
+    // Required, the cache follows its responses and timeouts through the manager.
+    void setManager(SNMPManager *manager)
+    {
+        _manager = manager;
+    }
+
+    // Send as SNMPv3 using the security settings of the engine, for agents registered without one.
+    void setEngine(SNMPv3Engine *engine)
+    {
+        _get.setEngine(engine);
+    }
+
+    // How long a fetched value is served without asking the agent again, in milliseconds
+    void setTTL(unsigned long ttl)
+    {
+        _ttl = ttl;
+    }
+
+    // Returns true if the handler's value was fetched less than the TTL ago, so its destination can be read now. Otherwise the
+    // handler is fetched by loop(), or by the request already fetching it, and the value arrives through the handler as usual.
+    bool request(ValueCallback *handler);
+    // Makes the next request() for the handler fetch it again
+    void invalidate(ValueCallback *handler);
+    // Call from loop() alongside the manager's loop(), sends the GetRequests for the handlers requested since.
+    void loop();
+
+    // request() calls answered from the cache
+    unsigned long hits()
+    {
+        return _hits;
+    }
+    // request() calls that needed a fetch, including those joining one already under way
+    unsigned long misses()
+    {
+        return _misses;
+    }
+    // Misses that joined a fetch already wanted or in flight rather than causing another
+    unsigned long coalesced()
+    {
+        return _coalesced;
+    }
+    void resetCounters()
+    {
+        _hits = 0;
+        _misses = 0;
+        _coalesced = 0;
+    }
+
+    bool onResponse(IPAddress ip, unsigned long requestID, int errorStatus, int errorIndex, uint8_t tag);
+    void onTimeout(IPAddress ip, unsigned long requestID, uint8_t tag);
+    void onResponseFailed(IPAddress ip, unsigned long requestID, uint8_t tag);
+
+private:
+    SNMPGet _get;
+    SNMPManager *_manager = 0;
+    unsigned long _ttl;
+    unsigned long _nextRequestID;
+    unsigned long _hits = 0;
+    unsigned long _misses = 0;
+    unsigned long _coalesced = 0;
+    SNMPCacheEntry _entries[SNMP_CACHE_ENTRIES];
+
+    SNMPCacheEntry *find(ValueCallback *handler);
+    SNMPCacheEntry *allocate();
+    void endFetch(unsigned long requestID, bool fresh);
+};
+
+SNMPCacheEntry *SNMPCache::find(ValueCallback *handler)
+{
+    for (int i = 0; i < SNMP_CACHE_ENTRIES; i++)
+    {
+        if (_entries[i].handler == handler)
+        {
+            return &_entries[i];
+        }
+    }
+    return 0;
+}
+
+SNMPCacheEntry *SNMPCache::allocate()
+{
+    // An unused entry, one of a removed handler, or else the idle entry fetched longest ago
+    SNMPCacheEntry *oldest = 0;
+    unsigned long now = millis();
+    for (int i = 0; i < SNMP_CACHE_ENTRIES; i++)
+    {
+        SNMPCacheEntry *entry = &_entries[i];
+        if (!entry->handler || (!entry->handler->agent && entry->state != SNMP_CACHE_IN_FLIGHT))
+        {
+            return entry;
+        }
+        if (entry->state == SNMP_CACHE_IDLE && (!oldest || now - entry->fetchedAt > now - oldest->fetchedAt))
+        {
+            oldest = entry;
+        }
+    }
+    return oldest;
+}
+
+bool SNMPCache::request(ValueCallback *handler)
+{
+    if (!handler || !handler->agent || handler->isPrefix)
+    {
+        return false;
+    }
+    SNMPCacheEntry *entry = find(handler);
+    if (entry && entry->fresh && handler->hasValue && millis() - entry->fetchedAt < _ttl)
+    {
+        _hits++;
+        return true;
+    }
+    _misses++;
+    if (entry && entry->state != SNMP_CACHE_IDLE)
+    {
+        _coalesced++;
+        return false;
+    }
+    if (!entry)
+    {
+        entry = allocate();
+        if (!entry)
+        {
+#ifdef DEBUG
+            Serial.println(F("[DEBUG] SNMPCache: All entries are being fetched"));
+#endif
+            return false;
+        }
+        entry->handler = handler;
+        entry->fresh = false;
+    }
+    entry->state = SNMP_CACHE_WANTED;
+    return false;
+}
+
+void SNMPCache::invalidate(ValueCallback *handler)
+{
+    SNMPCacheEntry *entry = find(handler);
+    if (entry)
+    {
+        entry->fresh = false;
+    }
+}
+
+void SNMPCache::loop()
+{
+    if (!_manager)
+    {
+        return;
+    }
+    for (int i = 0; i < SNMP_CACHE_ENTRIES; i++)
+    {
+        if (_entries[i].state != SNMP_CACHE_WANTED)
+        {
+            continue;
+        }
+        SNMPAgent *agent = _entries[i].handler->agent;
+        if (!agent)
+        {
+            _entries[i].state = SNMP_CACHE_IDLE; // Removed since it was requested
+            continue;
+        }
+        if (!_manager->canSend(agent->ip))
+        {
+            continue; // Waits for the agent's window or the rate limit
+        }
+        // Everything wanted from the same agent goes in one request
+        unsigned long requestID = _nextRequestID;
+        _nextRequestID = (_nextRequestID % 0x7FFF) + 1;
+        _get.clearOIDList();
+        for (int j = i; j < SNMP_CACHE_ENTRIES && _get.oidCount() < SNMP_CACHE_REQUEST_OIDS; j++)
+        {
+            if (_entries[j].state == SNMP_CACHE_WANTED && _entries[j].handler->agent == agent)
+            {
+                _get.addOIDPointer(_entries[j].handler);
+                _entries[j].state = SNMP_CACHE_IN_FLIGHT;
+                _entries[j].requestID = requestID;
+            }
+        }
+        _get.setRequestID(requestID);
+        // Tracked before it is sent, so nothing goes out that can't be followed. A failed send (or an SNMPv3 engine discovery
+        // sent instead) leaves the handlers wanted.
+        bool tracked = _manager->trackRequest(agent->ip, requestID, this);
+        if (!tracked || !_get.sendTo(agent))
+        {
+            if (tracked)
+            {
+                _manager->cancelRequest(agent->ip, requestID);
+            }
+            for (int j = i; j < SNMP_CACHE_ENTRIES; j++)
+            {
+                if (_entries[j].state == SNMP_CACHE_IN_FLIGHT && _entries[j].requestID == requestID)
+                {
+                    _entries[j].state = SNMP_CACHE_WANTED;
+                }
+            }
+            return;
+        }
+    }
+}
+
+void SNMPCache::endFetch(unsigned long requestID, bool fresh)
+{
+    unsigned long now = millis();
+    for (int i = 0; i < SNMP_CACHE_ENTRIES; i++)
+    {
+        SNMPCacheEntry *entry = &_entries[i];
+        if (entry->state == SNMP_CACHE_IN_FLIGHT && entry->requestID == requestID)
+        {
+            entry->state = SNMP_CACHE_IDLE;
+            if (fresh)
+            {
+                entry->fresh = true;
+                entry->fetchedAt = now;
+            }
+        }
+    }
+}
+
+bool SNMPCache::onResponse(IPAddress ip, unsigned long requestID, int errorStatus, int errorIndex, uint8_t tag)
+{
+    endFetch(requestID, !errorStatus);
+    return errorStatus != 0; // The values still go to their handlers
+}
+
+void SNMPCache::onTimeout(IPAddress ip, unsigned long requestID, uint8_t tag)
+{
+    endFetch(requestID, false);
+}
+
+void SNMPCache::onResponseFailed(IPAddress ip, unsigned long requestID, uint8_t tag)
+{
+    // The fetch was ended by onResponse(), but not every value may have arrived
+    for (int i = 0; i < SNMP_CACHE_ENTRIES; i++)
+    {
+        if (_entries[i].state == SNMP_CACHE_IDLE && _entries[i].requestID == requestID)
+        {
+            _entries[i].fresh = false;
+        }
+    }
+}
+
+#endif
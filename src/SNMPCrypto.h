@@ -0,0 +1,413 @@
+#ifndef SNMPCrypto_h
+#define SNMPCrypto_h
+
+// Minimal MD5, SHA-1, HMAC and AES-128 (encrypt direction only, as needed by CFB mode) for SNMPv3 USM.
+// Self contained so the library doesn't depend on the crypto support of a particular core.
+
+#define SNMP_HASH_BLOCK_SIZE 64
+#define SNMP_MAX_DIGEST_SIZE 20
+#define SNMP_AES_KEY_SIZE 16
+#define SNMP_AES_BLOCK_SIZE 16
+
+typedef enum SNMPAuthProtocolEnum
+{
+    SNMP_AUTH_NONE = 0,
+    SNMP_AUTH_MD5 = 1,
+    SNMP_AUTH_SHA = 2
+} SNMPAuthProtocol;
+
+typedef enum SNMPPrivProtocolEnum
+{
+    SNMP_PRIV_NONE = 0,
+    SNMP_PRIV_AES = 1
+} SNMPPrivProtocol;
+
+inline int snmpDigestSize(SNMPAuthProtocol protocol)
+{
+    return protocol == SNMP_AUTH_SHA ? 20 : 16;
+}
+
+inline uint32_t snmpRotateLeft(uint32_t value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+class SNMPHash
+{
+public:
+    SNMPHash(){};
+    SNMPHash(SNMPAuthProtocol protocol)
+    {
+        begin(protocol);
+    };
+    SNMPAuthProtocol _protocol;
+    uint32_t _state[5];
+    uint32_t _count; // bytes hashed so far, SNMP never hashes more than 4GB
+    uint8_t _buffer[SNMP_HASH_BLOCK_SIZE];
+
+    int digestSize()
+    {
+        return snmpDigestSize(_protocol);
+    }
+
+    void begin(SNMPAuthProtocol protocol)
+    {
+        _protocol = protocol;
+        _count = 0;
+        _state[0] = 0x67452301;
+        _state[1] = 0xEFCDAB89;
+        _state[2] = 0x98BADCFE;
+        _state[3] = 0x10325476;
+        _state[4] = 0xC3D2E1F0;
+    }
+
+    void update(const uint8_t *data, size_t length)
+    {
+        size_t used = _count % SNMP_HASH_BLOCK_SIZE;
+        _count += length;
+        if (used)
+        {
+            size_t fill = SNMP_HASH_BLOCK_SIZE - used;
+            if (length < fill)
+            {
+                memcpy(_buffer + used, data, length);
+                return;
+            }
+            memcpy(_buffer + used, data, fill);
+            transform(_buffer);
+            data += fill;
+            length -= fill;
+        }
+        while (length >= SNMP_HASH_BLOCK_SIZE)
+        {
+            transform(data);
+            data += SNMP_HASH_BLOCK_SIZE;
+            length -= SNMP_HASH_BLOCK_SIZE;
+        }
+        memcpy(_buffer, data, length);
+    }
+
+    void finish(uint8_t *digest)
+    {
+        uint64_t bits = (uint64_t)_count * 8;
+        uint8_t pad = 0x80;
+        update(&pad, 1);
+        pad = 0;
+        while (_count % SNMP_HASH_BLOCK_SIZE != 56)
+        {
+            update(&pad, 1);
+        }
+        uint8_t length[8];
+        for (int i = 0; i < 8; i++)
+        {
+            // MD5 appends the bit count little endian, SHA-1 big endian
+            length[i] = _protocol == SNMP_AUTH_SHA ? bits >> (56 - i * 8) : bits >> (i * 8);
+        }
+        update(length, 8);
+        for (int i = 0; i < digestSize() / 4; i++)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                digest[i * 4 + k] = _protocol == SNMP_AUTH_SHA ? _state[i] >> (24 - k * 8) : _state[i] >> (k * 8);
+            }
+        }
+    }
+
+private:
+    void transform(const uint8_t *block)
+    {
+        if (_protocol == SNMP_AUTH_SHA)
+        {
+            sha1Transform(block);
+        }
+        else
+        {
+            md5Transform(block);
+        }
+    }
+
+    void md5Transform(const uint8_t *block)
+    {
+        static const uint8_t shifts[16] = {7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21};
+        // floor(abs(sin(i + 1)) * 2^32)
+        static const uint32_t constants[64] = {
+            0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+            0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+            0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+            0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+            0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+            0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+            0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+            0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+        uint32_t x[16];
+        for (int i = 0; i < 16; i++)
+        {
+            x[i] = (uint32_t)block[i * 4] | ((uint32_t)block[i * 4 + 1] << 8) | ((uint32_t)block[i * 4 + 2] << 16) | ((uint32_t)block[i * 4 + 3] << 24);
+        }
+        uint32_t a = _state[0], b = _state[1], c = _state[2], d = _state[3];
+        for (int i = 0; i < 64; i++)
+        {
+            uint32_t f;
+            int g;
+            switch (i / 16)
+            {
+            case 0:
+                f = (b & c) | (~b & d);
+                g = i;
+                break;
+            case 1:
+                f = (d & b) | (~d & c);
+                g = (5 * i + 1) % 16;
+                break;
+            case 2:
+                f = b ^ c ^ d;
+                g = (3 * i + 5) % 16;
+                break;
+            default:
+                f = c ^ (b | ~d);
+                g = (7 * i) % 16;
+                break;
+            }
+            uint32_t temp = d;
+            d = c;
+            c = b;
+            b = b + snmpRotateLeft(a + f + constants[i] + x[g], shifts[(i / 16) * 4 + i % 4]);
+            a = temp;
+        }
+        _state[0] += a;
+        _state[1] += b;
+        _state[2] += c;
+        _state[3] += d;
+    }
+
+    void sha1Transform(const uint8_t *block)
+    {
+        uint32_t w[16];
+        for (int i = 0; i < 16; i++)
+        {
+            w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) | ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+        }
+        uint32_t a = _state[0], b = _state[1], c = _state[2], d = _state[3], e = _state[4];
+        for (int i = 0; i < 80; i++)
+        {
+            if (i >= 16)
+            {
+                // Message schedule kept in a rolling 16 word window
+                w[i & 15] = snmpRotateLeft(w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15], 1);
+            }
+            uint32_t f, k;
+            if (i < 20)
+            {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            }
+            else if (i < 40)
+            {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            }
+            else if (i < 60)
+            {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t temp = snmpRotateLeft(a, 5) + f + e + k + w[i & 15];
+            e = d;
+            d = c;
+            c = snmpRotateLeft(b, 30);
+            b = a;
+            a = temp;
+        }
+        _state[0] += a;
+        _state[1] += b;
+        _state[2] += c;
+        _state[3] += d;
+        _state[4] += e;
+    }
+};
+
+class SNMPHmac
+{
+public:
+    // The hash state after absorbing the key xor'd with the inner and outer pads. Computed once per key, each
+    // message then only costs hashing the message itself plus one extra block for the outer hash.
+    SNMPHash _inner;
+    SNMPHash _outer;
+
+    void setKey(SNMPAuthProtocol protocol, const uint8_t *key, int keyLength)
+    {
+        uint8_t pad[SNMP_HASH_BLOCK_SIZE];
+        memset(pad, 0, SNMP_HASH_BLOCK_SIZE);
+        memcpy(pad, key, keyLength); // USM keys are 16 or 20 bytes, never longer than a block
+        for (int i = 0; i < SNMP_HASH_BLOCK_SIZE; i++)
+        {
+            pad[i] ^= 0x36;
+        }
+        _inner.begin(protocol);
+        _inner.update(pad, SNMP_HASH_BLOCK_SIZE);
+        for (int i = 0; i < SNMP_HASH_BLOCK_SIZE; i++)
+        {
+            pad[i] ^= 0x36 ^ 0x5C;
+        }
+        _outer.begin(protocol);
+        _outer.update(pad, SNMP_HASH_BLOCK_SIZE);
+    }
+
+    void compute(const uint8_t *data, size_t length, uint8_t *digest)
+    {
+        SNMPHash hash = _inner;
+        hash.update(data, length);
+        hash.finish(digest);
+        hash = _outer;
+        hash.update(digest, hash.digestSize());
+        hash.finish(digest);
+    }
+};
+
+static const uint8_t snmpAesSbox[256] PROGMEM = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16};
+
+class SNMPAes128
+{
+public:
+    uint8_t _roundKeys[176]; // Expanded once per key
+
+    void setKey(const uint8_t *key)
+    {
+        memcpy(_roundKeys, key, SNMP_AES_KEY_SIZE);
+        uint8_t rcon = 0x01;
+        for (int i = 16; i < 176; i += 4)
+        {
+            uint8_t t[4] = {_roundKeys[i - 4], _roundKeys[i - 3], _roundKeys[i - 2], _roundKeys[i - 1]};
+            if (i % 16 == 0)
+            {
+                uint8_t first = t[0];
+                t[0] = pgm_read_byte(&snmpAesSbox[t[1]]) ^ rcon;
+                t[1] = pgm_read_byte(&snmpAesSbox[t[2]]);
+                t[2] = pgm_read_byte(&snmpAesSbox[t[3]]);
+                t[3] = pgm_read_byte(&snmpAesSbox[first]);
+                rcon = xtime(rcon);
+            }
+            for (int k = 0; k < 4; k++)
+            {
+                _roundKeys[i + k] = _roundKeys[i - 16 + k] ^ t[k];
+            }
+        }
+    }
+
+    void encryptBlock(const uint8_t *in, uint8_t *out)
+    {
+        uint8_t s[16];
+        for (int i = 0; i < 16; i++)
+        {
+            s[i] = in[i] ^ _roundKeys[i];
+        }
+        for (int round = 1; round <= 10; round++)
+        {
+            // SubBytes and ShiftRows together, state is column major
+            uint8_t t[16];
+            for (int i = 0; i < 16; i++)
+            {
+                t[i] = pgm_read_byte(&snmpAesSbox[s[(i + (i % 4) * 4) % 16]]);
+            }
+            if (round < 10)
+            {
+                // MixColumns
+                for (int c = 0; c < 16; c += 4)
+                {
+                    uint8_t a0 = t[c], a1 = t[c + 1], a2 = t[c + 2], a3 = t[c + 3];
+                    uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+                    t[c] ^= all ^ xtime(a0 ^ a1);
+                    t[c + 1] ^= all ^ xtime(a1 ^ a2);
+                    t[c + 2] ^= all ^ xtime(a2 ^ a3);
+                    t[c + 3] ^= all ^ xtime(a3 ^ a0);
+                }
+            }
+            for (int i = 0; i < 16; i++)
+            {
+                s[i] = t[i] ^ _roundKeys[round * 16 + i];
+            }
+        }
+        memcpy(out, s, 16);
+    }
+
+    // CFB-128 as used by SNMPv3 (RFC 3826). Works in place, length need not be a multiple of the block size.
+    void cfb(uint8_t *data, size_t length, const uint8_t *iv, bool decrypt)
+    {
+        uint8_t feedback[SNMP_AES_BLOCK_SIZE];
+        uint8_t keystream[SNMP_AES_BLOCK_SIZE];
+        memcpy(feedback, iv, SNMP_AES_BLOCK_SIZE);
+        for (size_t offset = 0; offset < length; offset += SNMP_AES_BLOCK_SIZE)
+        {
+            encryptBlock(feedback, keystream);
+            size_t n = length - offset < SNMP_AES_BLOCK_SIZE ? length - offset : SNMP_AES_BLOCK_SIZE;
+            for (size_t i = 0; i < n; i++)
+            {
+                uint8_t in = data[offset + i];
+                data[offset + i] = in ^ keystream[i];
+                feedback[i] = decrypt ? in : data[offset + i];
+            }
+        }
+    }
+
+private:
+    static uint8_t xtime(uint8_t x)
+    {
+        return (x << 1) ^ ((x & 0x80) ? 0x1B : 0x00);
+    }
+};
+
+// RFC 3414 A.2: hash one megabyte of the repeated password. This is the expensive step, so the result is cached by the
+// user and only the cheap localisation (below) is repeated per agent.
+inline void snmpPasswordToKey(SNMPAuthProtocol protocol, const char *password, uint8_t *key)
+{
+    SNMPHash hash(protocol);
+    int passwordLength = strlen(password);
+    uint8_t block[SNMP_HASH_BLOCK_SIZE];
+    int index = 0;
+    for (long count = 0; count < 1048576; count += SNMP_HASH_BLOCK_SIZE)
+    {
+        for (int i = 0; i < SNMP_HASH_BLOCK_SIZE; i++)
+        {
+            block[i] = password[index++ % passwordLength];
+        }
+        hash.update(block, SNMP_HASH_BLOCK_SIZE);
+        if (count % 16384 == 0)
+        {
+            delay(0); // Let the WiFi stack run during the long hash
+        }
+    }
+    hash.finish(key);
+}
+
+inline void snmpLocalizeKey(SNMPAuthProtocol protocol, const uint8_t *key, const uint8_t *engineID, int engineIDLength, uint8_t *localizedKey)
+{
+    SNMPHash hash(protocol);
+    int keyLength = hash.digestSize();
+    hash.update(key, keyLength);
+    hash.update(engineID, engineIDLength);
+    hash.update(key, keyLength);
+    hash.finish(localizedKey);
+}
+
+#endif
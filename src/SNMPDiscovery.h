@@ -0,0 +1,257 @@
+#ifndef SNMPDiscovery_h
+#define SNMPDiscovery_h
+
+#ifndef SNMP_DISCOVERY_RATE
+#define SNMP_DISCOVERY_RATE 1000 // Requests sent per second during a sweep
+#endif
+
+#ifndef SNMP_DISCOVERY_BURST
+#define SNMP_DISCOVERY_BURST 8 // Requests that can be sent back to back after a pause
+#endif
+
+#ifndef SNMP_DISCOVERY_NAME_LENGTH
+#define SNMP_DISCOVERY_NAME_LENGTH 32 // Longest sysName passed to the discovery callback, including the terminator
+#endif
+
+// Called for each agent answering a sweep, with its sysObjectID as a dotted string and its sysName.
+typedef void (*DiscoveryCallback)(IPAddress ip, const char *sysObjectID, const char *sysName);
+
+// Sweeps a network for agents, sending a GetRequest for sysObjectID.0 and sysName.0 to every address and adding each agent
+// that answers to the manager. The request is encoded once, only the request ID is patched for each address, and the sends
+// are paced by a token bucket. Responses are matched by request ID range, so the sweep takes no pending request slots.
+class SNMPDiscovery : public SNMPRequestOwner
+{
+public:
+    SNMPDiscovery(const char *community, short version) : _community(community), _version(version){};
+    ~SNMPDiscovery()
+    {
+        if (_manager)
+        {
+            _manager->cancelRequests(this);
+        }
+        free(_packet);
+    };
+    const char *_community;
+    short _version;
+    short port = 161;
+
+    void setPort(short portnumber)
+    {
+        port = portnumber;
+    }
+
+    void setUDP(UDP *udp)
+    {
+        _udp = udp;
+    }
+
+    // Required, the responses are passed back through the manager and the agents found are added to it.
+    void setManager(SNMPManager *manager)
+    {
+        _manager = manager;
+    }
+
+    // Requests sent per second, and how many can be sent back to back.
+    void setRate(unsigned int perSecond, uint8_t burst)
+    {
+        _rate = perSecond;
+        _burst = burst;
+    }
+
+    void setCallback(DiscoveryCallback callback)
+    {
+        _callback = callback;
+    }
+
+    // Starts a sweep of network/prefixLength (8 to 30), leaving out the network and broadcast addresses. SNMPv1/v2c only.
+    // Returns false if another sweep is still running on the same manager, as they share its one request ID range.
+    bool begin(IPAddress network, uint8_t prefixLength);
+    // Call from loop() alongside the manager's loop(), sends the requests the token bucket allows. Returns false once the sweep
+    // has finished, SNMP_REQUEST_TIMEOUT after the last request.
+    bool loop();
+
+    bool isRunning()
+    {
+        return _running;
+    }
+
+    // Agents that have answered the current or last sweep
+    unsigned int found()
+    {
+        return _found;
+    }
+
+    bool onResponse(IPAddress ip, unsigned long requestID, int errorStatus, int errorIndex, uint8_t tag);
+    bool onResponseVarBind(IPAddress ip, const unsigned char *oid, uint8_t oidLength, BER_CONTAINER *value, uint8_t tag);
+    void onResponseComplete(IPAddress ip, uint8_t tag);
+    void onTimeout(IPAddress ip, unsigned long requestID, uint8_t tag){};
+
+private:
+    UDP *_udp = 0;
+    SNMPManager *_manager = 0;
+    DiscoveryCallback _callback = 0;
+    unsigned int _rate = SNMP_DISCOVERY_RATE;
+    uint8_t _burst = SNMP_DISCOVERY_BURST;
+    unsigned char *_packet = 0;
+    int _packetLength;
+    int _requestIDOffset; // Where the 4 byte request ID sits in the packet
+    unsigned long _firstRequestID;
+    uint32_t _firstHost;
+    uint32_t _hostCount;
+    uint32_t _next = 0;
+    unsigned long _tokens;     // Thousandths of a request
+    unsigned long _refilledAt;
+    unsigned long _lastSentAt;
+    unsigned int _found = 0;
+    bool _running = false;
+    char _sysObjectID[MAX_OID_LENGTH];
+    char _sysName[SNMP_DISCOVERY_NAME_LENGTH];
+
+    IPAddress host(uint32_t index)
+    {
+        uint32_t address = _firstHost + index;
+        return IPAddress(address >> 24, (address >> 16) & 0xFF, (address >> 8) & 0xFF, address & 0xFF);
+    }
+};
+
+// sysObjectID.0 and sysName.0, BER encoded
+static const unsigned char snmpSysObjectIDOID[] = {0x2B, 0x06, 0x01, 0x02, 0x01, 0x01, 0x02, 0x00};
+static const unsigned char snmpSysNameOID[] = {0x2B, 0x06, 0x01, 0x02, 0x01, 0x01, 0x05, 0x00};
+
+bool SNMPDiscovery::begin(IPAddress network, uint8_t prefixLength)
+{
+    if (_running || !_udp || !_manager || _version == SNMP_VERSION_3 || prefixLength < 8 || prefixLength > 30)
+    {
+        return false;
+    }
+    // Request IDs from 0x01000000 up always take 4 bytes, so each address's ID is patched into the same place
+    _hostCount = (1UL << (32 - prefixLength)) - 2;
+    _firstRequestID = 0x01000000UL + random(0x40000000L);
+    uint32_t mask = 0xFFFFFFFFUL << (32 - prefixLength);
+    _firstHost = ((((uint32_t)network[0] << 24) | ((uint32_t)network[1] << 16) | ((uint32_t)network[2] << 8) | network[3]) & mask) + 1;
+
+    int varBindsLength = 2 * (2 + 2 + sizeof(snmpSysNameOID) + 2);
+    free(_packet);
+    _packet = (unsigned char *)malloc(32 + strlen(_community) + varBindsLength);
+    if (!_packet)
+    {
+        return false;
+    }
+    int length = berWriteMessageHeader(_packet, _community, _version, GetRequestPDU, _firstRequestID, varBindsLength);
+    // The PDU header ends with the request ID, errorStatus and errorIndex (3 bytes each when 0) and the varbind list header
+    _requestIDOffset = length - (1 + berLengthSize(varBindsLength)) - 3 - 3 - 4;
+    const unsigned char *oids[] = {snmpSysObjectIDOID, snmpSysNameOID};
+    for (int i = 0; i < 2; i++)
+    {
+        _packet[length++] = STRUCTURE;
+        _packet[length++] = 2 + sizeof(snmpSysNameOID) + 2;
+        _packet[length++] = ASN_TYPE::OID;
+        _packet[length++] = sizeof(snmpSysNameOID);
+        memcpy(_packet + length, oids[i], sizeof(snmpSysNameOID));
+        length += sizeof(snmpSysNameOID);
+        _packet[length++] = NULLTYPE;
+        _packet[length++] = 0;
+    }
+    _packetLength = length;
+
+    if (!_manager->trackRequestRange(_firstRequestID, _hostCount, this))
+    {
+        Serial.println(F("Another sweep is using the manager's request ID range, wait for it to finish"));
+        return false;
+    }
+    _next = 0;
+    _found = 0;
+    _tokens = _burst * 1000UL;
+    _refilledAt = millis();
+    _running = true;
+    return true;
+}
+
+bool SNMPDiscovery::loop()
+{
+    if (!_running)
+    {
+        return false;
+    }
+    unsigned long now = millis();
+    _tokens += (now - _refilledAt) * _rate;
+    if (_tokens > _burst * 1000UL)
+    {
+        _tokens = _burst * 1000UL;
+    }
+    _refilledAt = now;
+    while (_next < _hostCount && _tokens >= 1000)
+    {
+        unsigned long requestID = _firstRequestID + _next;
+        _packet[_requestIDOffset] = requestID >> 24;
+        _packet[_requestIDOffset + 1] = requestID >> 16;
+        _packet[_requestIDOffset + 2] = requestID >> 8;
+        _packet[_requestIDOffset + 3] = requestID;
+        _udp->beginPacket(host(_next), port);
+        _udp->write(_packet, _packetLength);
+        _udp->endPacket();
+        _next++;
+        _tokens -= 1000;
+        _lastSentAt = now;
+    }
+    if (_next >= _hostCount && now - _lastSentAt >= SNMP_REQUEST_TIMEOUT)
+    {
+        _manager->cancelRequests(this);
+        _running = false;
+        free(_packet);
+        _packet = 0;
+    }
+    return _running;
+}
+
+bool SNMPDiscovery::onResponse(IPAddress ip, unsigned long requestID, int errorStatus, int errorIndex, uint8_t tag)
+{
+    // The request ID says which address the request went to, anything else answering with it is ignored
+    if (errorStatus || host(requestID - _firstRequestID) != ip)
+    {
+        return true;
+    }
+    _sysObjectID[0] = 0;
+    _sysName[0] = 0;
+    return false;
+}
+
+bool SNMPDiscovery::onResponseVarBind(IPAddress ip, const unsigned char *oid, uint8_t oidLength, BER_CONTAINER *value, uint8_t tag)
+{
+    if (oidLength != sizeof(snmpSysNameOID))
+    {
+        return true;
+    }
+    if (value->_type == ASN_TYPE::OID && memcmp(oid, snmpSysObjectIDOID, oidLength) == 0)
+    {
+        strncpy(_sysObjectID, ((OIDType *)value)->_value, MAX_OID_LENGTH - 1);
+        _sysObjectID[MAX_OID_LENGTH - 1] = 0;
+    }
+    else if (value->_type == STRING && memcmp(oid, snmpSysNameOID, oidLength) == 0)
+    {
+        strncpy(_sysName, ((OctetType *)value)->_value, SNMP_DISCOVERY_NAME_LENGTH - 1);
+        _sysName[SNMP_DISCOVERY_NAME_LENGTH - 1] = 0;
+    }
+    return true;
+}
+
+void SNMPDiscovery::onResponseComplete(IPAddress ip, uint8_t tag)
+{
+    // Agents already registered keep their settings
+    SNMPAgent *agent = _manager->findAgent(ip);
+    if (!agent || agent->version == SNMP_VERSION_UNSET)
+    {
+        _manager->addAgent(ip, _community, _version, port);
+    }
+    _found++;
+#ifdef DEBUG
+    Serial.print(F("[DEBUG] SNMPDiscovery: Found agent: "));
+    Serial.println(ip);
+#endif
+    if (_callback)
+    {
+        _callback(ip, _sysObjectID, _sysName);
+    }
+}
+
+#endif
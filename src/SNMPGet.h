@@ -1,21 +1,12 @@
 #ifndef SNMPGet_h
 #define SNMPGet_h
 
-enum SNMPExpect
-{
-	HEADER,
-	SNMPVERSION,
-	COMMUNITY,
-	PDU,
-	REQUESTID,
-	ERRORSTATUS,
-	ERRORID,
-	VARBINDS,
-	VARBIND,
-	DONE
-};
+class SNMPGet;
+
+// Called once the response to a tracked GetRequest has been handled, ok being false if it timed out or answered an error.
+typedef void (*GetCompleteCallback)(SNMPGet *request, IPAddress ip, bool ok);
 
-class SNMPGet
+class SNMPGet : public SNMPRequestOwner
 {
 public:
 	SNMPGet(const char *community, short version) : _community(community), _version(version)
@@ -29,6 +20,13 @@ public:
 			version2 = true;
 		}
 	};
+	~SNMPGet()
+	{
+		if (_manager)
+		{
+			_manager->cancelRequests(this);
+		}
+	};
 	const char *_community;
 	short _version;
 	IPAddress agentIP;
@@ -59,121 +57,233 @@ public:
 		_udp = udp;
 	}
 
-	void addOIDPointer(ValueCallback *callback);
-	ValueCallbacks *callbacks = new ValueCallbacks();
-	ValueCallbacks *callbacksCursor = callbacks;
+	// Tracking requests with the manager allows completion to be reported, once the values have been passed to their handlers.
+	void setManager(SNMPManager *manager)
+	{
+		_manager = manager;
+	}
+
+	void setCompleteCallback(GetCompleteCallback callback)
+	{
+		_completeCallback = callback;
+	}
+
+	// Send as SNMPv3 using the security settings of the engine, the community and version are then ignored.
+	void setEngine(SNMPv3Engine *engine)
+	{
+		_engine = engine;
+	}
+
+	void addOIDPointer(ValueCallback *callback)
+	{
+		_oids.add(callback);
+	}
+	void removeOIDPointer(ValueCallback *callback)
+	{
+		_oids.remove(callback);
+	}
+
+	// Only count OIDs, from first, are sent, so a long list can be split across several requests. A count of -1 sends them all.
+	void setRange(int first, int count)
+	{
+		_rangeFirst = first;
+		_rangeCount = count;
+	}
+
+	int oidCount()
+	{
+		return _oids.count();
+	}
 
 	UDP *_udp = 0;
+	SNMPv3Engine *_engine = 0;
 	bool sendTo(IPAddress ip)
+	{
+		return send(ip, port, _community, _version, _engine);
+	}
+
+	// Send using the version, community, port and engine registered for the agent, rather than this request's own.
+	bool sendTo(SNMPAgent *agent)
+	{
+		if (!agent)
+		{
+			return false;
+		}
+		short version = agent->version == SNMP_VERSION_UNSET ? _version : agent->version;
+		return send(agent->ip, agent->port, agent->community ? agent->community : _community, version, agent->engine);
+	}
+
+	bool send(IPAddress ip, uint16_t toPort, const char *community, short version, SNMPv3Engine *engine)
 	{
 		if (!_udp)
 		{
 			return false;
 		}
-		if (!build())
+		if (engine && !engine->isDiscovered())
+		{
+			// The agent's engine ID, boots and time are needed before an authenticated request can be sent
+			unsigned char discovery[SNMP_V3_HEADER_RESERVE];
+			int length = engine->discoveryMessage(discovery, SNMP_V3_HEADER_RESERVE, requestID);
+#ifdef DEBUG
+			Serial.print(F("[DEBUG] SNMPGet: Sending SNMPv3 engine discovery to: "));
+			Serial.println(ip);
+#endif
+			if (length)
+			{
+				_udp->beginPacket(ip, toPort);
+				_udp->write(discovery, length);
+				_udp->endPacket();
+			}
+			return false;
+		}
+		_oids.dropRemoved();
+		SNMPBuffer buffer(maxLength(community, engine));
+		unsigned char *packetBuffer = buffer.data;
+		int length = 0;
+		if (!packetBuffer)
+		{
+			Serial.println(F("Too many OIDs for one GetRequest"));
+		}
+		else if (engine)
+		{
+			// Write the PDU past the room needed for the v3 header, the engine then wraps it in place
+			unsigned char *pdu = packetBuffer + SNMP_V3_HEADER_RESERVE;
+			int pduLength = berWritePDUHeader(pdu, GetRequestPDU, requestID, varBindsLength(), errorID, errorIndex);
+			pduLength += writeVarBinds(pdu + pduLength);
+			length = engine->wrap(pdu, pduLength, packetBuffer, buffer.size);
+		}
+		else
+		{
+			length = berWriteMessageHeader(packetBuffer, community, version, GetRequestPDU, requestID, varBindsLength(), errorID, errorIndex);
+			length += writeVarBinds(packetBuffer + length);
+		}
+		if (!length || (_manager && !_manager->trackRequest(ip, requestID, this)))
 		{
-			Serial.println(F("Failed Building packet.."));
-			delete packet;
-			packet = 0;
 			return false;
 		}
-		unsigned char _packetBuffer[SNMP_PACKET_LENGTH * 3];
-		memset(_packetBuffer, 0, SNMP_PACKET_LENGTH * 3);
-		int length = packet->serialise(_packetBuffer);
-		delete packet;
-		packet = 0;
 #ifdef DEBUG
     Serial.print(F("[DEBUG] SNMPGet: Sending UDP packet to: "));
     Serial.print(ip);
     Serial.print(F(":"));
-    Serial.println(port);
+    Serial.println(toPort);
 		Serial.print("[DEBUG] composed packet: ");
     for (int i = 0; i < length; i++)
     {
-        Serial.printf("%02x ", _packetBuffer[i]);
+        Serial.printf("%02x ", packetBuffer[i]);
     }
     Serial.println();
 #endif
-		_udp->beginPacket(ip, port);
-		_udp->write(_packetBuffer, length);
-		return _udp->endPacket();
+		_udp->beginPacket(ip, toPort);
+		_udp->write(packetBuffer, length);
+		if (!_udp->endPacket())
+		{
+			// Not sent, so it isn't left to time out and be reported as failed
+			if (_manager)
+			{
+				_manager->cancelRequest(ip, requestID);
+			}
+			return false;
+		}
+		return true;
 	}
 
-	ComplexType *packet = 0;
-	bool build();
+	unsigned int maxLength(const char *community, SNMPv3Engine *engine);
+	unsigned int varBindsLength();
+	int writeVarBinds(unsigned char *buf);
 
 	bool version1 = false;
 	bool version2 = false;
 
 	void clearOIDList()
-	{ // this just removes the list, does not kill the values in the list
-		callbacksCursor = callbacks;
-		delete callbacksCursor;
-		callbacks = new ValueCallbacks();
-		callbacksCursor = callbacks;
+	{ // this just empties the list, does not kill the values in the list
+		_oids.clear();
+	}
+
+	bool onResponse(IPAddress ip, unsigned long requestID, int errorStatus, int errorIndex, uint8_t tag);
+	void onResponseComplete(IPAddress ip, uint8_t tag);
+	void onTimeout(IPAddress ip, unsigned long requestID, uint8_t tag);
+
+private:
+	SNMPManager *_manager = 0;
+	GetCompleteCallback _completeCallback = 0;
+	SNMPOIDList _oids; // Handlers of the OIDs to request
+	int _rangeFirst = 0;
+	int _rangeCount = -1;
+	int rangeEnd()
+	{
+		return (_rangeCount < 0 || _rangeFirst + _rangeCount > _oids.count()) ? _oids.count() : _rangeFirst + _rangeCount;
 	}
 };
 
-bool SNMPGet::build()
+unsigned int SNMPGet::varBindsLength()
 {
-	// Build packet for making GetRequest
-	if (packet)
+	unsigned int length = 0;
+	for (int i = _rangeFirst; i < rangeEnd(); i++)
 	{
-		packet = 0;
+		unsigned int varBindLength = 2 + _oids[i]->oidLength + 2; // OID then NULL
+		length += 1 + berLengthSize(varBindLength) + varBindLength;
 	}
-	packet = new ComplexType(STRUCTURE);
-	packet->addValueToList(new IntegerType((int)_version));
-	packet->addValueToList(new OctetType((char *)_community));
-	ComplexType *getPDU;
-	getPDU = new ComplexType(GetRequestPDU);
-	getPDU->addValueToList(new IntegerType(requestID));
-	getPDU->addValueToList(new IntegerType(errorID));
-	getPDU->addValueToList(new IntegerType(errorIndex));
-	ComplexType *varBindList = new ComplexType(STRUCTURE);
+	return length;
+}
 
-	callbacksCursor = callbacks;
-	if (callbacksCursor->value)
+unsigned int SNMPGet::maxLength(const char *community, SNMPv3Engine *engine)
+{
+	// Message and PDU headers are at most 32 bytes besides the community, or the v3 header reserve
+	return 32 + (engine ? SNMP_V3_HEADER_RESERVE : strlen(community)) + varBindsLength();
+}
+
+int SNMPGet::writeVarBinds(unsigned char *buf)
+{
+	// The OIDs are already BER encoded in their handlers, so each varbind is copied straight out of the array
+	unsigned char *ptr = buf;
+	for (int i = _rangeFirst; i < rangeEnd(); i++)
 	{
-		while (true)
-		{
-			ComplexType *varBind = new ComplexType(STRUCTURE);
-			varBind->addValueToList(new OIDType(callbacksCursor->value->OID));
-			// Value can be null for Request payload.
-			BER_CONTAINER *value = new NullType();
-			varBind->addValueToList(value);
-			varBindList->addValueToList(varBind);
-
-			if (callbacksCursor->next)
-			{
-				callbacksCursor = callbacksCursor->next;
-			}
-			else
-			{
-				break;
-			}
-		}
+		ValueCallback *callback = _oids[i];
+		*ptr++ = STRUCTURE;
+		ptr += berWriteLength(ptr, 2 + callback->oidLength + 2);
+		*ptr++ = ASN_TYPE::OID;
+		*ptr++ = callback->oidLength;
+		memcpy(ptr, callback->oid, callback->oidLength);
+		ptr += callback->oidLength;
+		*ptr++ = NULLTYPE; // Value is null for a GetRequest
+		*ptr++ = 0;
+	}
+	return ptr - buf;
+}
+
+bool SNMPGet::onResponse(IPAddress ip, unsigned long requestID, int errorStatus, int errorIndex, uint8_t tag)
+{
+	if (!errorStatus)
+	{
+		return false; // The values go to their handlers, completion is reported by onResponseComplete()
+	}
+	Serial.print(F("Error response from: "));
+	Serial.print(ip);
+	Serial.print(F(" - Error Status: "));
+	Serial.print(errorStatus);
+	Serial.print(F(" - Error Index: "));
+	Serial.println(errorIndex);
+	if (_completeCallback)
+	{
+		_completeCallback(this, ip, false);
 	}
-	getPDU->addValueToList(varBindList);
-	packet->addValueToList(getPDU);
 	return true;
 }
 
-void SNMPGet::addOIDPointer(ValueCallback *callback)
+void SNMPGet::onResponseComplete(IPAddress ip, uint8_t tag)
 {
-	callbacksCursor = callbacks;
-	if (callbacksCursor->value)
+	if (_completeCallback)
 	{
-		while (callbacksCursor->next != 0)
-		{
-			callbacksCursor = callbacksCursor->next;
-		}
-		callbacksCursor->next = new ValueCallbacks();
-		callbacksCursor = callbacksCursor->next;
-		callbacksCursor->value = callback;
-		callbacksCursor->next = 0;
+		_completeCallback(this, ip, true);
+	}
+}
+
+void SNMPGet::onTimeout(IPAddress ip, unsigned long requestID, uint8_t tag)
+{
+	if (_completeCallback)
+	{
+		_completeCallback(this, ip, false);
 	}
-	else
-		callbacks->value = callback;
 }
 
-#endif
\ No newline at end of file
+#endif
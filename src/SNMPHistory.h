@@ -0,0 +1,247 @@
+#ifndef SNMPHistory_h
+#define SNMPHistory_h
+
+#ifndef SNMP_HISTORY_TICK
+#define SNMP_HISTORY_TICK 100 // Milliseconds per unit of the time stored between samples, so gaps of up to 65535 ticks can be held
+#endif
+
+// A ring of the most recent samples of one handler's value, each stored as a float and the time since the previous sample,
+// 6 bytes a sample. Counters are stored as their rate per second, so the history shows traffic rather than an ever growing count.
+// The minimum, maximum, mean and rate of change of the last window of samples are kept up to date as samples are added.
+// Another history can be fed the mean of every few samples, for a longer but coarser view.
+class SNMPHistory
+{
+public:
+    SNMPHistory(uint16_t capacity) : _capacity(capacity), _window(capacity)
+    {
+        _values = (float *)malloc(capacity * sizeof(float));
+        _deltas = (uint16_t *)malloc(capacity * sizeof(uint16_t));
+        if (!_values || !_deltas)
+        {
+            _capacity = 0;
+        }
+    };
+    ~SNMPHistory()
+    {
+        free(_values);
+        free(_deltas);
+    };
+
+    // Samples the statistics cover, from 1 up to the capacity. Clears the history.
+    void setWindow(uint16_t samples);
+    // Every factor samples added, their mean is added to the coarser history
+    void setDownsample(SNMPHistory *coarser, uint8_t factor);
+    void clear();
+
+    void add(unsigned long time, float value);
+    // Adds the rate per second since the previous count. The first count only sets the starting point, as does a 64 bit count
+    // lower than the previous one (the agent restarted). 32 bit counts are taken to have wrapped.
+    void addCounter(unsigned long time, uint64_t count, bool wraps32);
+
+    uint16_t count()
+    {
+        return _count;
+    }
+    uint16_t capacity()
+    {
+        return _capacity;
+    }
+    // Sample age samples before the newest, 0 being the newest
+    float value(uint16_t age);
+    // Copies up to max samples, oldest first, with the millis() they were added at. Returns how many.
+    uint16_t read(unsigned long *times, float *values, uint16_t max);
+
+    // Statistics of the last window of samples, 0 when there are none
+    float min()
+    {
+        return _windowCount ? _min : 0;
+    }
+    float max()
+    {
+        return _windowCount ? _max : 0;
+    }
+    float mean()
+    {
+        return _windowCount ? _sum / _windowCount : 0;
+    }
+    // Change per second from the oldest to the newest sample of the window
+    float rate();
+
+private:
+    float *_values;
+    uint16_t *_deltas; // Ticks since the previous sample
+    uint16_t _capacity;
+    uint16_t _count = 0;
+    uint16_t _newest = 0; // Index of the newest sample
+    unsigned long _newestTime;
+    uint16_t _window;
+    uint16_t _windowCount = 0;
+    float _sum = 0;
+    float _min;
+    float _max;
+    unsigned long _windowSpan = 0; // Ticks from the oldest sample of the window to the newest
+    SNMPHistory *_coarser = 0;
+    uint8_t _factor;
+    uint8_t _pending = 0;
+    float _pendingSum = 0;
+    bool _hasCount = false; // A counter's previous count has been seen
+    uint64_t _lastCount;
+    unsigned long _lastCountTime;
+
+    uint16_t index(uint16_t age)
+    {
+        return (_newest + _capacity - age) % _capacity;
+    }
+    void rescanWindow();
+};
+
+void SNMPHistory::setWindow(uint16_t samples)
+{
+    _window = samples < 1 ? 1 : samples > _capacity ? _capacity : samples;
+    clear();
+}
+
+void SNMPHistory::setDownsample(SNMPHistory *coarser, uint8_t factor)
+{
+    _coarser = coarser;
+    _factor = factor ? factor : 1;
+    _pending = 0;
+    _pendingSum = 0;
+}
+
+void SNMPHistory::clear()
+{
+    _count = 0;
+    _windowCount = 0;
+    _sum = 0;
+    _windowSpan = 0;
+    _hasCount = false;
+}
+
+void SNMPHistory::add(unsigned long time, float value)
+{
+    if (!_capacity)
+    {
+        return;
+    }
+    unsigned long ticks = _count ? (time - _newestTime) / SNMP_HISTORY_TICK : 0;
+    uint16_t delta = ticks > 0xFFFF ? 0xFFFF : ticks;
+    bool rescan = false;
+    if (_windowCount == _window)
+    {
+        // The oldest sample of the window leaves it, taken out before the new sample can overwrite it
+        float leaving = _values[index(_window - 1)];
+        _sum -= leaving;
+        if (_window > 1)
+        {
+            _windowSpan -= _deltas[index(_window - 2)];
+        }
+        rescan = leaving <= _min || leaving >= _max;
+        _windowCount--;
+    }
+    _newest = _count ? (_newest + 1) % _capacity : 0;
+    if (_count < _capacity)
+    {
+        _count++;
+    }
+    _values[_newest] = value;
+    _deltas[_newest] = delta;
+    // Kept to whole ticks from the previous sample, so the times read back don't drift from the ones stored
+    _newestTime = (_count == 1 || ticks > 0xFFFF) ? time : _newestTime + (unsigned long)delta * SNMP_HISTORY_TICK;
+    _sum += value;
+    if (_windowCount++)
+    {
+        _windowSpan += delta;
+    }
+    if (_windowCount == 1)
+    {
+        _min = value;
+        _max = value;
+    }
+    else if (rescan)
+    {
+        // Only when the minimum or maximum left the window, so usually each sample costs the same
+        rescanWindow();
+    }
+    else
+    {
+        _min = value < _min ? value : _min;
+        _max = value > _max ? value : _max;
+    }
+
+    if (_coarser)
+    {
+        _pendingSum += value;
+        if (++_pending >= _factor)
+        {
+            _coarser->add(time, _pendingSum / _pending);
+            _pending = 0;
+            _pendingSum = 0;
+        }
+    }
+}
+
+void SNMPHistory::addCounter(unsigned long time, uint64_t count, bool wraps32)
+{
+    if (_hasCount && time != _lastCountTime && (wraps32 || count >= _lastCount))
+    {
+        uint64_t difference = wraps32 ? (uint32_t)(count - _lastCount) : count - _lastCount;
+        add(time, difference * 1000.0f / (time - _lastCountTime));
+    }
+    _hasCount = true;
+    _lastCount = count;
+    _lastCountTime = time;
+}
+
+void SNMPHistory::rescanWindow()
+{
+    // The sum is added up again too, clearing the rounding left by taking samples out of it
+    _min = _values[_newest];
+    _max = _min;
+    _sum = 0;
+    for (uint16_t age = 0; age < _windowCount; age++)
+    {
+        float value = _values[index(age)];
+        _min = value < _min ? value : _min;
+        _max = value > _max ? value : _max;
+        _sum += value;
+    }
+}
+
+float SNMPHistory::rate()
+{
+    if (_windowCount < 2 || !_windowSpan)
+    {
+        return 0;
+    }
+    return (_values[_newest] - _values[index(_windowCount - 1)]) * 1000.0f / (_windowSpan * SNMP_HISTORY_TICK);
+}
+
+float SNMPHistory::value(uint16_t age)
+{
+    return age < _count ? _values[index(age)] : 0;
+}
+
+uint16_t SNMPHistory::read(unsigned long *times, float *values, uint16_t max)
+{
+    uint16_t count = _count < max ? _count : max;
+    // Times are found back from the newest sample, then the samples copied forward from the oldest wanted
+    unsigned long time = _newestTime;
+    for (uint16_t age = 0; age + 1 < count; age++)
+    {
+        time -= (unsigned long)_deltas[index(age)] * SNMP_HISTORY_TICK;
+    }
+    for (uint16_t i = 0; i < count; i++)
+    {
+        uint16_t age = count - 1 - i;
+        if (i)
+        {
+            time += (unsigned long)_deltas[index(age)] * SNMP_HISTORY_TICK;
+        }
+        times[i] = time;
+        values[i] = _values[index(age)];
+    }
+    return count;
+}
+
+#endif
@@ -0,0 +1,320 @@
+#ifndef SNMPPollGroup_h
+#define SNMPPollGroup_h
+
+#ifndef SNMP_POLL_LATENCY_FACTOR
+#define SNMP_POLL_LATENCY_FACTOR 4 // A group is polled no more often than this many times its agent's smoothed response time
+#endif
+
+class SNMPPollGroup;
+
+// Called when every request of a poll has been answered or timed out, ok being false if any timed out or answered an error.
+typedef void (*PollCompleteCallback)(SNMPPollGroup *group, bool ok);
+
+// OIDs polled together from one agent, at an interval which adapts between a minimum and a maximum.
+// The interval halves when a poll changes any value, grows by a quarter when nothing changed and doubles on a timeout,
+// so groups of static values (sysName, ifSpeed) soon settle at the maximum while changing counters stay near the minimum.
+// When the agent answers tooBig the OIDs are split across more requests and polled again, the batch size being kept for later polls.
+class SNMPPollGroup : public SNMPRequestOwner
+{
+public:
+    SNMPPollGroup(const char *community, short version, unsigned long minInterval, unsigned long maxInterval) : _get(community, version), _minInterval(minInterval), _maxInterval(maxInterval), _interval(minInterval)
+    {
+        _nextRequestID = random(0x7FFF) + 1;
+    };
+    ~SNMPPollGroup()
+    {
+        if (_manager)
+        {
+            _manager->cancelRequests(this);
+        }
+    };
+
+    void setUDP(UDP *udp)
+    {
+        _get.setUDP(udp);
+    }
+
+    // Required, the group follows its responses and timeouts through the manager.
+    void setManager(SNMPManager *manager)
+    {
+        _manager = manager;
+    }
+
+    // Sent with the version, community, port and engine of the agent registered for the address, if there is one.
+    void setIP(IPAddress ip)
+    {
+        _ip = ip;
+    }
+
+    // Send as SNMPv3 using the security settings of the engine, when no agent is registered for the address.
+    void setEngine(SNMPv3Engine *engine)
+    {
+        _get.setEngine(engine);
+    }
+
+    void setCompleteCallback(PollCompleteCallback callback)
+    {
+        _completeCallback = callback;
+    }
+
+    void setIntervals(unsigned long minInterval, unsigned long maxInterval)
+    {
+        _minInterval = minInterval;
+        _maxInterval = maxInterval;
+        adjustInterval(_interval);
+    }
+
+    void addOIDPointer(ValueCallback *callback)
+    {
+        _get.addOIDPointer(callback);
+    }
+    void removeOIDPointer(ValueCallback *callback)
+    {
+        _get.removeOIDPointer(callback);
+    }
+    void clearOIDList()
+    {
+        _get.clearOIDList();
+    }
+
+    // Current interval between polls, in milliseconds
+    unsigned long interval()
+    {
+        return _interval;
+    }
+
+    // Smoothed response time of the agent, in milliseconds. 0 until the first response.
+    unsigned long latency()
+    {
+        return _latency;
+    }
+
+    // Most OIDs sent in one request, 0 while they all go in one
+    int batchSize()
+    {
+        return _batchSize;
+    }
+
+    // Call from loop(), sends the GetRequest when the group is due and the manager allows it. Returns true if it was sent.
+    // Requests of a poll the pending request table had no room for are sent here once there is room.
+    bool poll();
+    // Sends the GetRequests now, unless any are still awaiting a response, ignoring the agent's window and the rate limit.
+    // Sends the rest of the current poll instead, if it couldn't all be sent.
+    bool pollNow();
+
+    bool onResponse(IPAddress ip, unsigned long requestID, int errorStatus, int errorIndex, uint8_t tag);
+    void onResponseComplete(IPAddress ip, uint8_t tag);
+    void onResponseFailed(IPAddress ip, unsigned long requestID, uint8_t tag);
+    void onTimeout(IPAddress ip, unsigned long requestID, uint8_t tag);
+    void onCancelled(IPAddress ip, unsigned long requestID, uint8_t tag);
+
+private:
+    SNMPGet _get;
+    SNMPManager *_manager = 0;
+    PollCompleteCallback _completeCallback = 0;
+    IPAddress _ip;
+    unsigned long _minInterval;
+    unsigned long _maxInterval;
+    unsigned long _interval;
+    unsigned long _latency = 0;
+    unsigned long _sentAt = 0;
+    bool _sent = false;       // At least one poll has been sent
+    uint8_t _outstanding = 0; // Requests of the current poll awaiting a response
+    int _batchSize = 0;       // 0 while all the OIDs go in one request
+    int _sentBatchSize;       // Batch size of the current poll
+    int _nextFirst = 0;       // First OID of the current poll still to be sent, 0 once all have been
+    unsigned int _changed;    // Values changed by the current poll
+    bool _timedOut;
+    bool _failed; // An error other than tooBig was answered
+    bool _tooBig;
+    unsigned long _nextRequestID;
+    void adjustInterval(unsigned long interval);
+    void finishPoll();
+};
+
+void SNMPPollGroup::adjustInterval(unsigned long interval)
+{
+    // Slow agents aren't polled faster than they answer
+    unsigned long minimum = _latency * SNMP_POLL_LATENCY_FACTOR > _minInterval ? _latency * SNMP_POLL_LATENCY_FACTOR : _minInterval;
+    if (interval < minimum)
+    {
+        interval = minimum;
+    }
+    if (interval > _maxInterval)
+    {
+        interval = _maxInterval;
+    }
+    _interval = interval;
+}
+
+bool SNMPPollGroup::poll()
+{
+    if (_nextFirst)
+    {
+        return _manager && _manager->canSend(_ip) && pollNow(); // The rest of the current poll
+    }
+    if (_outstanding || (_sent && millis() - _sentAt < _interval) || !_manager || !_manager->canSend(_ip))
+    {
+        return false; // Not due, or it waits for the agent's window or the rate limit
+    }
+    return pollNow();
+}
+
+bool SNMPPollGroup::pollNow()
+{
+    int count = _get.oidCount();
+    if (!_manager || !count || (_outstanding && !_nextFirst))
+    {
+        return false;
+    }
+    if (!_nextFirst)
+    {
+        _sentBatchSize = _batchSize ? _batchSize : count;
+        _changed = 0;
+        _timedOut = false;
+        _failed = false;
+        _tooBig = false;
+    }
+    // The time is taken when nothing is awaiting a response, so waiting for room in the pending request table doesn't count as
+    // the agent's response time
+    bool idle = !_outstanding;
+    unsigned long now = millis();
+    SNMPAgent *agent = _manager->findAgent(_ip);
+    bool sent = false;
+    int first = _nextFirst;
+    for (; first < count && _outstanding < 0xFF; first += _sentBatchSize)
+    {
+        unsigned long requestID = _nextRequestID;
+        _nextRequestID = (_nextRequestID % 0x7FFF) + 1;
+        if (!_manager->trackRequest(_ip, requestID, this))
+        {
+            break; // The rest are sent by poll() once the pending request table has room
+        }
+        _get.setRequestID(requestID);
+        _get.setRange(first, _sentBatchSize);
+        if (!(agent ? _get.sendTo(agent) : _get.sendTo(_ip)))
+        {
+            // Not sent, or an SNMPv3 engine discovery was sent instead, so the poll is given up
+            _manager->cancelRequests(this);
+            _outstanding = 0;
+            first = count;
+            sent = false;
+            _sent = true; // Tried again at the next interval
+            _sentAt = now;
+            break;
+        }
+        _outstanding++;
+        sent = true;
+    }
+    _nextFirst = first < count ? first : 0;
+    _get.setRange(0, -1);
+    if (sent)
+    {
+        _sent = true;
+        if (idle)
+        {
+            _sentAt = now;
+        }
+    }
+    return sent;
+}
+
+bool SNMPPollGroup::onResponse(IPAddress ip, unsigned long requestID, int errorStatus, int errorIndex, uint8_t tag)
+{
+    _outstanding--;
+    // Smoothed as TCP does its round trip time, 7/8 of the previous estimate and 1/8 of the new sample
+    unsigned long sample = millis() - _sentAt;
+    _latency = _latency ? (_latency * 7 + sample) / 8 : sample;
+    if (!errorStatus)
+    {
+        return false; // The varbinds go to their handlers, the poll finishes in onResponseComplete()
+    }
+    if (errorStatus == SNMP_ERROR_TOO_BIG && _sentBatchSize > 1)
+    {
+        _batchSize = _sentBatchSize / 2;
+        _tooBig = true;
+    }
+    else
+    {
+        _failed = true;
+        Serial.print(F("Error response to poll from: "));
+        Serial.print(ip);
+        Serial.print(F(" - Error Status: "));
+        Serial.print(errorStatus);
+        Serial.print(F(" - Error Index: "));
+        Serial.println(errorIndex);
+    }
+    if (!_outstanding && !_nextFirst)
+    {
+        finishPoll();
+    }
+    return true;
+}
+
+void SNMPPollGroup::onResponseComplete(IPAddress ip, uint8_t tag)
+{
+    _changed += _manager->changedValues();
+    if (!_outstanding && !_nextFirst)
+    {
+        finishPoll();
+    }
+}
+
+void SNMPPollGroup::onResponseFailed(IPAddress ip, unsigned long requestID, uint8_t tag)
+{
+    _failed = true; // Already counted as answered by onResponse()
+    if (!_outstanding && !_nextFirst)
+    {
+        finishPoll();
+    }
+}
+
+void SNMPPollGroup::onTimeout(IPAddress ip, unsigned long requestID, uint8_t tag)
+{
+    _outstanding--;
+    _timedOut = true;
+    if (!_outstanding && !_nextFirst)
+    {
+        finishPoll();
+    }
+}
+
+void SNMPPollGroup::onCancelled(IPAddress ip, unsigned long requestID, uint8_t tag)
+{
+    // The rest of the poll isn't sent, and it finishes as failed rather than being polled again in smaller requests
+    _outstanding--;
+    _nextFirst = 0;
+    _failed = true;
+    _tooBig = false;
+    if (!_outstanding)
+    {
+        finishPoll();
+    }
+}
+
+void SNMPPollGroup::finishPoll()
+{
+    bool ok = !_timedOut && !_failed && !_tooBig;
+    if (_tooBig && pollNow())
+    {
+        return; // Polled again straight away in smaller requests
+    }
+    if (_timedOut)
+    {
+        adjustInterval(_interval * 2);
+    }
+    else if (_changed)
+    {
+        adjustInterval(_interval / 2);
+    }
+    else
+    {
+        adjustInterval(_interval + _interval / 4);
+    }
+    if (_completeCallback)
+    {
+        _completeCallback(this, ok);
+    }
+}
+
+#endif
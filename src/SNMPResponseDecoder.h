@@ -0,0 +1,414 @@
+#ifndef SNMPResponseDecoder_h
+#define SNMPResponseDecoder_h
+
+#ifndef SNMP_DECODER_VALUE_LENGTH
+#define SNMP_DECODER_VALUE_LENGTH 128 // Longest OID or value (plus 4 bytes of header) held in the decoder. Longer strings borrow a pool buffer.
+#endif
+
+#ifndef SNMP_DECODER_OID_LENGTH
+#define SNMP_DECODER_OID_LENGTH 64 // Longest BER encoded OID in a response that can be matched, at most 255. Longer varbinds are skipped.
+#endif
+
+#ifndef SNMP_DECODER_COMMUNITY_LENGTH
+#define SNMP_DECODER_COMMUNITY_LENGTH 32 // Longest community string kept from a response, longer ones are truncated and so won't match.
+#endif
+
+// Receives the parts of a message as soon as they have been decoded.
+class SNMPResponseHandler
+{
+public:
+    virtual ~SNMPResponseHandler(){};
+    // Called once the PDU header has been decoded. Return false to skip the varbinds.
+    virtual bool onHeader(int version, const char *community, ASN_TYPE pduType, unsigned long requestID, int errorStatus, int errorIndex) = 0;
+    // Called as each varbind is completed with its BER encoded OID, value is deleted on return. Return false to skip the remaining varbinds.
+    virtual bool onVarBind(const unsigned char *oid, uint8_t oidLength, BER_CONTAINER *value) = 0;
+};
+
+enum SNMPDecodeState
+{
+    DECODING,
+    DECODE_DONE,    // All the varbinds have been decoded
+    DECODE_STOPPED, // The handler asked for the rest of the message to be skipped
+    DECODE_FAILED   // Not a message we can decode
+};
+
+// Decodes a message a few bytes at a time, so the whole datagram never has to be held in memory.
+// Only the value currently being decoded is buffered.
+class SNMPResponseDecoder
+{
+public:
+    SNMPResponseDecoder(SNMPResponseHandler *handler) : _handler(handler){};
+    ~SNMPResponseDecoder()
+    {
+        end();
+    }
+
+    // Start of a v1/v2c message
+    void begin()
+    {
+        reset(EXPECT_MESSAGE);
+    }
+
+    // Start at the PDU, for SNMPv3 where the engine has already removed the message header
+    void beginPDU(int version)
+    {
+        reset(EXPECT_PDU);
+        _version = version;
+        _community[0] = 0;
+    }
+
+    // Feed the next bytes of the message. Returns true while more bytes are wanted.
+    bool decode(const unsigned char *data, int length);
+    // Call once the message has been fed. Gives back the pool buffer of a string the message ended part way through.
+    void end()
+    {
+        if (_longValue)
+        {
+            SNMPBufferPool::release(_longValue);
+            _longValue = 0;
+        }
+    }
+
+    SNMPDecodeState state()
+    {
+        return _state;
+    }
+
+private:
+    enum Expect
+    {
+        EXPECT_MESSAGE,
+        EXPECT_VERSION,
+        EXPECT_COMMUNITY,
+        EXPECT_PDU,
+        EXPECT_REQUESTID,
+        EXPECT_ERRORSTATUS,
+        EXPECT_ERRORINDEX,
+        EXPECT_VARBINDS,
+        EXPECT_VARBIND,
+        EXPECT_VARBIND_OID,
+        EXPECT_VARBIND_VALUE
+    };
+    enum Stage
+    {
+        STAGE_TAG,
+        STAGE_LENGTH,
+        STAGE_LONG_LENGTH,
+        STAGE_CONTENT
+    };
+
+    SNMPResponseHandler *_handler;
+    SNMPDecodeState _state = DECODE_DONE;
+    Expect _expect;
+    Stage _stage;
+    unsigned char _tag;
+    unsigned int _length;
+    uint8_t _lengthBytes;
+    unsigned int _contentRead;
+    unsigned long _offset; // Bytes decoded so far
+    unsigned long _varBindsEnd;
+    bool _skipVarBind;
+
+    // Content of the current primitive, the TLV header is written in front of it once its length is known
+    unsigned char _value[SNMP_DECODER_VALUE_LENGTH];
+    unsigned int _valueLength;
+    // A string too long for _value is collected here instead, in a buffer from the pool of _longValueSize bytes
+    unsigned char *_longValue = 0;
+    unsigned int _longValueSize;
+
+    int _version;
+    char _community[SNMP_DECODER_COMMUNITY_LENGTH + 1];
+    ASN_TYPE _pduType;
+    unsigned long _requestID;
+    int _errorStatus;
+    unsigned char _oid[SNMP_DECODER_OID_LENGTH];
+    uint8_t _oidLength;
+
+    void reset(Expect expect)
+    {
+        end();
+        _state = DECODING;
+        _expect = expect;
+        _stage = STAGE_TAG;
+        _offset = 0;
+    }
+    void fail()
+    {
+#ifdef DEBUG
+        Serial.print(F("[DEBUG] Failed decoding response, tag: "));
+        Serial.print(_tag, HEX);
+        Serial.print(F(" at offset: "));
+        Serial.println(_offset);
+#endif
+        _state = DECODE_FAILED;
+    }
+    void beginElement();
+    void endElement();
+    void endVarBind();
+    unsigned char *valueTLV();
+};
+
+bool SNMPResponseDecoder::decode(const unsigned char *data, int length)
+{
+    const unsigned char *end = data + length;
+    while (data < end && _state == DECODING)
+    {
+        switch (_stage)
+        {
+        case STAGE_TAG:
+            _tag = *data++;
+            _offset++;
+            _stage = STAGE_LENGTH;
+            break;
+        case STAGE_LENGTH:
+            _length = *data++;
+            _offset++;
+            if (_length & 0x80)
+            {
+                _lengthBytes = _length & 0x7F;
+                _length = 0;
+                if (_lengthBytes == 0 || _lengthBytes > 2)
+                {
+                    fail();
+                    break;
+                }
+                _stage = STAGE_LONG_LENGTH;
+            }
+            else
+            {
+                beginElement();
+            }
+            break;
+        case STAGE_LONG_LENGTH:
+            _length = (_length << 8) | *data++;
+            _offset++;
+            if (--_lengthBytes == 0)
+            {
+                beginElement();
+            }
+            break;
+        case STAGE_CONTENT:
+        {
+            // Take as much of the content as this chunk holds, keeping what fits in the value buffer
+            unsigned int count = MIN((unsigned int)(end - data), _length - _contentRead);
+            unsigned int room = (_longValue ? _longValueSize : sizeof(_value)) - 4 - _valueLength;
+            memcpy((_longValue ? _longValue : _value) + 4 + _valueLength, data, MIN(count, room));
+            _valueLength += MIN(count, room);
+            _contentRead += count;
+            _offset += count;
+            data += count;
+            if (_contentRead == _length)
+            {
+                endElement();
+            }
+        }
+        break;
+        }
+    }
+    return _state == DECODING;
+}
+
+void SNMPResponseDecoder::beginElement()
+{
+    // Constructed elements are entered straight away, only primitives have content to collect
+    switch (_expect)
+    {
+    case EXPECT_MESSAGE:
+        if (_tag != STRUCTURE)
+        {
+            fail();
+            return;
+        }
+        _expect = EXPECT_VERSION;
+        _stage = STAGE_TAG;
+        return;
+    case EXPECT_PDU:
+        // Any PDU shaped like a GetResponse, the v1 Trap-PDU has a different layout
+        if (_tag < GetRequestPDU || _tag > ReportPDU || _tag == TrapPDU)
+        {
+            fail();
+            return;
+        }
+        _pduType = (ASN_TYPE)_tag;
+        _expect = EXPECT_REQUESTID;
+        _stage = STAGE_TAG;
+        return;
+    case EXPECT_VARBINDS:
+        if (_tag != STRUCTURE)
+        {
+            fail();
+            return;
+        }
+        if (!_handler->onHeader(_version, _community, _pduType, _requestID, _errorStatus, berReadInteger(_value + 4, _valueLength)))
+        {
+            _state = DECODE_STOPPED;
+            return;
+        }
+        _varBindsEnd = _offset + _length;
+        _expect = EXPECT_VARBIND;
+        _stage = STAGE_TAG;
+        if (_length == 0)
+        {
+            _state = DECODE_DONE;
+        }
+        return;
+    case EXPECT_VARBIND:
+        if (_tag != STRUCTURE)
+        {
+            fail();
+            return;
+        }
+        _skipVarBind = false;
+        _expect = EXPECT_VARBIND_OID;
+        _stage = STAGE_TAG;
+        return;
+    case EXPECT_VERSION:
+    case EXPECT_REQUESTID:
+    case EXPECT_ERRORSTATUS:
+    case EXPECT_ERRORINDEX:
+        if (_tag != INTEGER || _length > 5)
+        {
+            fail();
+            return;
+        }
+        break;
+    case EXPECT_COMMUNITY:
+        if (_tag != STRING)
+        {
+            fail();
+            return;
+        }
+        break;
+    case EXPECT_VARBIND_OID:
+        if (_tag != OID)
+        {
+            fail();
+            return;
+        }
+        break;
+    case EXPECT_VARBIND_VALUE:
+        if (_tag == STRING && _length + 4 > sizeof(_value) && !_skipVarBind)
+        {
+            // Strings such as a long sysDescr can be as long as the packet, so they go in a packet sized buffer
+            _longValueSize = MIN(_length + 4, (unsigned int)SNMP_LARGE_BUFFER_LENGTH);
+            _longValue = SNMPBufferPool::acquire(_longValueSize);
+        }
+        break;
+    default:
+        break;
+    }
+    _valueLength = 0;
+    _contentRead = 0;
+    _stage = STAGE_CONTENT;
+    if (_length == 0)
+    {
+        endElement();
+    }
+}
+
+void SNMPResponseDecoder::endElement()
+{
+    _stage = STAGE_TAG;
+    switch (_expect)
+    {
+    case EXPECT_VERSION:
+        _version = berReadInteger(_value + 4, _valueLength) + 1;
+        _expect = EXPECT_COMMUNITY;
+        break;
+    case EXPECT_COMMUNITY:
+    {
+        unsigned int length = MIN(_valueLength, (unsigned int)SNMP_DECODER_COMMUNITY_LENGTH);
+        memcpy(_community, _value + 4, length);
+        _community[length] = 0;
+        _expect = EXPECT_PDU;
+    }
+    break;
+    case EXPECT_REQUESTID:
+        _requestID = berReadInteger(_value + 4, _valueLength);
+        _expect = EXPECT_ERRORSTATUS;
+        break;
+    case EXPECT_ERRORSTATUS:
+        _errorStatus = berReadInteger(_value + 4, _valueLength);
+        _expect = EXPECT_ERRORINDEX;
+        break;
+    case EXPECT_ERRORINDEX:
+        // Kept in _value until the varbind list starts, when the header is passed to the handler
+        _expect = EXPECT_VARBINDS;
+        break;
+    case EXPECT_VARBIND_OID:
+        if (_length == 0 || _length > SNMP_DECODER_OID_LENGTH)
+        {
+            // Too long to match any handler
+            _skipVarBind = true;
+        }
+        else
+        {
+            memcpy(_oid, _value + 4, _length);
+            _oidLength = _length;
+        }
+        _expect = EXPECT_VARBIND_VALUE;
+        break;
+    case EXPECT_VARBIND_VALUE:
+        if (_valueLength < _length && _tag != STRING)
+        {
+            // Only strings can be usefully truncated
+            _skipVarBind = true;
+        }
+        if (!_skipVarBind)
+        {
+            BER_CONTAINER *value = berNewContainer((ASN_TYPE)_tag);
+            value->fromBuffer(valueTLV());
+            end(); // Copied out, so the buffer is free for a request sent by the handler
+            bool more = _handler->onVarBind(_oid, _oidLength, value);
+            delete value;
+            if (!more)
+            {
+                _state = DECODE_STOPPED;
+                return;
+            }
+        }
+#ifdef DEBUG
+        else
+        {
+            Serial.print(F("[DEBUG] Skipped varbind too long to decode: "));
+            Serial.println(_length);
+        }
+#endif
+        end();
+        endVarBind();
+        break;
+    default:
+        break;
+    }
+}
+
+void SNMPResponseDecoder::endVarBind()
+{
+    if (_offset >= _varBindsEnd)
+    {
+        _state = DECODE_DONE;
+    }
+    else
+    {
+        _expect = EXPECT_VARBIND;
+    }
+}
+
+unsigned char *SNMPResponseDecoder::valueTLV()
+{
+    // Write the tag and length (of what was kept) in front of the content, in the form the BER classes expect
+    unsigned char *value = _longValue ? _longValue : _value;
+    if (_valueLength < 0x80)
+    {
+        value[2] = _tag;
+        value[3] = _valueLength;
+        return value + 2;
+    }
+    value[0] = _tag;
+    value[1] = 0x82;
+    value[2] = _valueLength >> 8;
+    value[3] = _valueLength & 0xFF;
+    return value;
+}
+
+#endif
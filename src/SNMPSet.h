@@ -0,0 +1,532 @@
+#ifndef SNMPSet_h
+#define SNMPSet_h
+
+#ifndef SNMP_MAX_SET_BATCHES
+#define SNMP_MAX_SET_BATCHES 8 // Maximum number of packets the varbinds of one SNMPSet can be split across.
+#endif
+
+#ifndef SNMP_MAX_SET_TARGETS
+#define SNMP_MAX_SET_TARGETS 8 // Agents one SNMPSet can be sending batches to at once, while their windows hold back the rest.
+#endif
+
+// An agent a SetRequest is being sent to, with the batch to send next once its window allows
+struct SNMPSetTarget
+{
+	IPAddress ip;
+	uint16_t port;
+	const char *community;
+	short version;
+	SNMPv3Engine *engine;
+	uint8_t nextBatch = 0;
+	uint8_t inFlight = 0;
+	bool used = false; // Free when unused, or once every batch has been sent and answered
+};
+
+// Called once per packet answered (or timed out). failed is the callback of the varbind named by errorIndex, or 0.
+typedef void (*SetResponseCallback)(IPAddress ip, int errorStatus, int errorIndex, ValueCallback *failed);
+
+class SNMPSet : public SNMPRequestOwner
+{
+public:
+	SNMPSet(const char *community, short version) : _community(community), _version(version)
+	{
+		_nextRequestID = random(0x7FFF) + 1;
+	};
+	~SNMPSet()
+	{
+		if (_manager)
+		{
+			_manager->cancelRequests(this);
+		}
+		free(_varBinds);
+	};
+	const char *_community;
+	short _version;
+	short port = 161;
+
+	void setPort(short portnumber)
+	{
+		port = portnumber;
+	}
+
+	void setUDP(UDP *udp)
+	{
+		_udp = udp;
+	}
+
+	// Tracking requests with the manager allows the response errorStatus/errorIndex to be reported.
+	void setManager(SNMPManager *manager)
+	{
+		_manager = manager;
+	}
+
+	// Send as SNMPv3 using the security settings of the engine, the community and version are then ignored.
+	void setEngine(SNMPv3Engine *engine)
+	{
+		_engine = engine;
+	}
+
+	void setResponseCallback(SetResponseCallback callback)
+	{
+		_responseCallback = callback;
+	}
+
+	// The value sent for each OID is read from the variable the callback points to.
+	void addOIDPointer(ValueCallback *callback)
+	{
+		if (_oids.add(callback))
+		{
+			_compiled = false;
+		}
+	}
+	void removeOIDPointer(ValueCallback *callback)
+	{
+		if (_oids.remove(callback))
+		{
+			listShrunk();
+		}
+	}
+
+	void clearOIDList()
+	{ // this just empties the list, does not kill the values in the list
+		_oids.clear();
+		_compiled = false;
+	}
+
+	// The varbinds are encoded once and reused for every sendTo(). Call recompile() after changing any of the values. Once compiled
+	// again, the batches of the previous values still waiting to be sent are dropped and their responses no longer reported.
+	bool compile();
+	void recompile()
+	{
+		_compiled = false;
+	}
+
+	// Sends without waiting for a response, so can be called for many agents in turn. When the manager is set, batches beyond the
+	// first are only sent while the agent's window allows, the rest following as responses arrive.
+	bool sendTo(IPAddress ip);
+	bool sendTo(IPAddress *ips, int count);
+	// Send using the version, community, port and engine registered for the agent, rather than this request's own.
+	bool sendTo(SNMPAgent *agent);
+
+	bool onResponse(IPAddress ip, unsigned long requestID, int errorStatus, int errorIndex, uint8_t tag);
+	void onTimeout(IPAddress ip, unsigned long requestID, uint8_t tag);
+	void onCancelled(IPAddress ip, unsigned long requestID, uint8_t tag);
+
+private:
+	UDP *_udp = 0;
+	SNMPManager *_manager = 0;
+	SNMPv3Engine *_engine = 0;
+	SetResponseCallback _responseCallback = 0;
+	SNMPOIDList _oids; // Handlers of the OIDs to set
+	bool _compiled = false;
+	unsigned char *_varBinds = 0; // Encoded varbinds for all batches, back to back
+	int _packetSize = 0;			// Send buffer needed for the largest batch
+	unsigned short _batchOffset[SNMP_MAX_SET_BATCHES + 1];
+	unsigned short _batchFirstIndex[SNMP_MAX_SET_BATCHES];
+	uint8_t _batchCount = 0;
+	unsigned long _nextRequestID;
+	SNMPSetTarget _targets[SNMP_MAX_SET_TARGETS];
+	SNMPSetTarget *findTarget(IPAddress ip);
+	bool sendBatches(SNMPSetTarget *target);
+	void batchEnded(IPAddress ip, bool sendRest);
+	int serialiseVarBind(ValueCallback *callback, unsigned char *buf, int maxLength);
+	bool send(IPAddress ip, uint16_t toPort, const char *community, short version, SNMPv3Engine *engine);
+	void listShrunk()
+	{
+		// The errorIndex of a response to a request already sent would now name the wrong varbind
+		if (_manager)
+		{
+			_manager->cancelRequests(this);
+		}
+		for (int i = 0; i < SNMP_MAX_SET_TARGETS; i++)
+		{
+			_targets[i] = SNMPSetTarget();
+		}
+		_compiled = false;
+	}
+	ValueCallback *callbackAt(int index)
+	{
+		// A handler removed from the manager since the request was sent is not passed on
+		return (index > 0 && index <= _oids.count() && _oids[index - 1]->agent) ? _oids[index - 1] : 0;
+	}
+};
+
+int SNMPSet::serialiseVarBind(ValueCallback *callback, unsigned char *buf, int maxLength)
+{
+	BER_CONTAINER *value;
+	switch (callback->type)
+	{
+	case INTEGER:
+		if (callback->isFloat)
+		{
+			value = new IntegerType((long)(*(float *)callback->value * 10));
+		}
+		else
+		{
+			value = new IntegerType(*(int *)callback->value);
+		}
+		break;
+	case STRING:
+	{
+		// Checked before serialising, a long string would run past the end of buf
+		size_t length = strnlen(*(char **)callback->value, SNMP_OCTETSTRING_MAX_LENGTH - 1);
+		if (4 + 2 + callback->oidLength + 4 + length > (size_t)maxLength)
+		{
+			Serial.println(F("String too long for SetRequest"));
+			return 0;
+		}
+		value = new OctetType(*(char **)callback->value);
+	}
+	break;
+	case ASN_TYPE::OID:
+		value = new OIDType((char *)callback->value);
+		break;
+	case COUNTER32:
+		value = new Counter32(*(uint32_t *)callback->value);
+		break;
+	case GAUGE32:
+		value = new Gauge(*(uint32_t *)callback->value);
+		break;
+	case TIMESTAMP:
+		value = new TimestampType(*(uint32_t *)callback->value);
+		break;
+	case COUNTER64:
+		value = new Counter64(*(uint64_t *)callback->value);
+		break;
+	default:
+		Serial.print(F("Unsupported type for SetRequest: "));
+		Serial.println(callback->type);
+		return 0;
+	}
+	// The value is written after the header once its length is known, the OID is copied from the handler as it is
+	unsigned char *valueBuf = buf + 4 + 2 + callback->oidLength;
+	int valueLength = value->serialise(valueBuf);
+	delete value;
+	int varBindLength = 2 + callback->oidLength + valueLength;
+	unsigned char *ptr = buf;
+	*ptr++ = STRUCTURE;
+	ptr += berWriteLength(ptr, varBindLength);
+	*ptr++ = ASN_TYPE::OID;
+	*ptr++ = callback->oidLength;
+	memcpy(ptr, callback->oid, callback->oidLength);
+	ptr += callback->oidLength;
+	memmove(ptr, valueBuf, valueLength);
+	return (ptr - buf) + valueLength;
+}
+
+bool SNMPSet::compile()
+{
+	// Leave room for the message and PDU headers around the varbinds of each batch
+	int headerReserve = 32 + strlen(_community);
+	int batchLimit = SNMP_PACKET_LENGTH - headerReserve;
+	SNMPBuffer buffer(SNMP_PACKET_LENGTH);
+	unsigned char *scratch = buffer.data;
+	if (!scratch)
+	{
+		return false;
+	}
+	if (_oids.dropRemoved())
+	{
+		listShrunk();
+	}
+	// Built aside, so the batches still being sent to agents stay as they are if this fails
+	unsigned char *varBinds = 0;
+	unsigned short batchOffset[SNMP_MAX_SET_BATCHES + 1];
+	unsigned short batchFirstIndex[SNMP_MAX_SET_BATCHES];
+	uint8_t batchCount = 0;
+	int total = 0;
+	int index = 1;
+	batchOffset[0] = 0;
+	batchFirstIndex[0] = 1;
+	int largestBatch = 0;
+	for (int i = 0; i < _oids.count(); i++)
+	{
+		int length = serialiseVarBind(_oids[i], scratch, batchLimit);
+		if (length == 0 || length > batchLimit)
+		{
+			free(varBinds);
+			return false;
+		}
+		if (total + length - batchOffset[batchCount] > batchLimit)
+		{
+			// Current batch is full, start the next packet
+			if (batchCount + 1 >= SNMP_MAX_SET_BATCHES)
+			{
+				Serial.println(F("Too many varbinds for SetRequest, increase SNMP_MAX_SET_BATCHES"));
+				free(varBinds);
+				return false;
+			}
+			if (total - batchOffset[batchCount] > largestBatch)
+			{
+				largestBatch = total - batchOffset[batchCount];
+			}
+			batchCount++;
+			batchOffset[batchCount] = total;
+			batchFirstIndex[batchCount] = index;
+		}
+		unsigned char *grown = (unsigned char *)realloc(varBinds, total + length);
+		if (!grown)
+		{
+			free(varBinds);
+			return false;
+		}
+		varBinds = grown;
+		memcpy(varBinds + total, scratch, length);
+		total += length;
+		index++;
+	}
+	if (total == 0)
+	{
+		return false;
+	}
+	if (total - batchOffset[batchCount] > largestBatch)
+	{
+		largestBatch = total - batchOffset[batchCount];
+	}
+	batchCount++;
+	batchOffset[batchCount] = total;
+
+	// Batches still being sent, and the errorIndex of their responses, belong to the varbinds being replaced
+	listShrunk();
+	free(_varBinds);
+	_varBinds = varBinds;
+	memcpy(_batchOffset, batchOffset, (batchCount + 1) * sizeof(batchOffset[0]));
+	memcpy(_batchFirstIndex, batchFirstIndex, batchCount * sizeof(batchFirstIndex[0]));
+	_batchCount = batchCount;
+	// Sized for either header, so the same compiled varbinds can go to v1/v2c and v3 agents alike
+	_packetSize = SNMP_V3_HEADER_RESERVE + 32 + largestBatch;
+	_compiled = true;
+	return _compiled;
+}
+
+bool SNMPSet::sendTo(IPAddress ip)
+{
+	return send(ip, port, _community, _version, _engine);
+}
+
+bool SNMPSet::sendTo(SNMPAgent *agent)
+{
+	if (!agent)
+	{
+		return false;
+	}
+	short version = agent->version == SNMP_VERSION_UNSET ? _version : agent->version;
+	return send(agent->ip, agent->port, agent->community ? agent->community : _community, version, agent->engine);
+}
+
+bool SNMPSet::send(IPAddress ip, uint16_t toPort, const char *community, short version, SNMPv3Engine *engine)
+{
+	if (!_udp)
+	{
+		return false;
+	}
+	if (_oids.dropRemoved())
+	{
+		listShrunk();
+	}
+	if (!_compiled && !compile())
+	{
+		Serial.println(F("Failed Building packet.."));
+		return false;
+	}
+	if (!engine && strlen(community) > SNMP_V3_HEADER_RESERVE)
+	{
+		Serial.println(F("Community too long for SetRequest"));
+		return false;
+	}
+	if (engine && !engine->isDiscovered())
+	{
+		// The agent's engine ID, boots and time are needed before an authenticated request can be sent
+		SNMPBuffer buffer(_packetSize);
+		if (!buffer.data)
+		{
+			return false;
+		}
+		int length = engine->discoveryMessage(buffer.data, _packetSize, _nextRequestID);
+		if (length)
+		{
+			_udp->beginPacket(ip, toPort);
+			_udp->write(buffer.data, length);
+			_udp->endPacket();
+		}
+		return false;
+	}
+	// Sending again to an agent still being sent to starts over, the values compiled now replacing any batches not yet sent
+	SNMPSetTarget *target = findTarget(ip);
+	if (!target)
+	{
+		Serial.println(F("Too many agents waiting for SetRequests, increase SNMP_MAX_SET_TARGETS"));
+		return false;
+	}
+	target->ip = ip;
+	target->port = toPort;
+	target->community = community;
+	target->version = version;
+	target->engine = engine;
+	target->nextBatch = 0;
+	target->used = true;
+	return sendBatches(target);
+}
+
+SNMPSetTarget *SNMPSet::findTarget(IPAddress ip)
+{
+	SNMPSetTarget *unused = 0;
+	for (int i = 0; i < SNMP_MAX_SET_TARGETS; i++)
+	{
+		SNMPSetTarget *target = &_targets[i];
+		bool idle = !target->used || (target->nextBatch >= _batchCount && !target->inFlight);
+		if (!idle && target->ip == ip)
+		{
+			return target;
+		}
+		if (idle && !unused)
+		{
+			unused = target;
+		}
+	}
+	return unused;
+}
+
+bool SNMPSet::sendBatches(SNMPSetTarget *target)
+{
+	SNMPBuffer buffer(_packetSize);
+	unsigned char *packet = buffer.data;
+	if (!packet)
+	{
+		target->used = target->inFlight != 0;
+		return false;
+	}
+	bool sent = true;
+	// Without the manager nothing is tracked, so every batch goes at once. With it one batch always goes, so each agent has a
+	// response to send the next from, and the others wait for the agent's window and the rate limit.
+	while (target->nextBatch < _batchCount && (!_manager || !target->inFlight || _manager->canSend(target->ip)))
+	{
+		uint8_t batch = target->nextBatch;
+		unsigned long requestID = _nextRequestID;
+		_nextRequestID = (_nextRequestID % 0x7FFFFFFF) + 1;
+		if (_manager && !_manager->trackRequest(target->ip, requestID, this, batch))
+		{
+			// With a batch in flight the rest go from its response, otherwise nothing would send them
+			target->used = target->inFlight != 0;
+			return false;
+		}
+		int varBindsLength = _batchOffset[batch + 1] - _batchOffset[batch];
+		int length;
+		if (target->engine)
+		{
+			// Write the PDU past the room needed for the v3 header, the engine then wraps it in place
+			unsigned char *pdu = packet + SNMP_V3_HEADER_RESERVE;
+			int pduLength = berWritePDUHeader(pdu, SetRequestPDU, requestID, varBindsLength);
+			memcpy(pdu + pduLength, _varBinds + _batchOffset[batch], varBindsLength);
+			length = target->engine->wrap(pdu, pduLength + varBindsLength, packet, _packetSize);
+			if (!length)
+			{
+				if (_manager)
+				{
+					_manager->cancelRequest(target->ip, requestID);
+				}
+				target->used = target->inFlight != 0;
+				return false;
+			}
+		}
+		else
+		{
+			length = berWriteMessageHeader(packet, target->community, target->version, SetRequestPDU, requestID, varBindsLength);
+			memcpy(packet + length, _varBinds + _batchOffset[batch], varBindsLength);
+			length += varBindsLength;
+		}
+#ifdef DEBUG
+		Serial.print(F("[DEBUG] SNMPSet: Sending UDP packet to: "));
+		Serial.print(target->ip);
+		Serial.print(F(":"));
+		Serial.println(target->port);
+		Serial.print("[DEBUG] composed packet: ");
+		for (int i = 0; i < length; i++)
+		{
+			Serial.printf("%02x ", packet[i]);
+		}
+		Serial.println();
+#endif
+		_udp->beginPacket(target->ip, target->port);
+		_udp->write(packet, length);
+		sent = _udp->endPacket() && sent;
+		target->nextBatch++;
+		if (_manager)
+		{
+			target->inFlight++;
+		}
+	}
+	return sent;
+}
+
+void SNMPSet::batchEnded(IPAddress ip, bool sendRest)
+{
+	// The agent's window has room again, so its next batches can go, unless they are being given up
+	for (int i = 0; i < SNMP_MAX_SET_TARGETS; i++)
+	{
+		SNMPSetTarget *target = &_targets[i];
+		if (target->used && target->inFlight && target->ip == ip)
+		{
+			target->inFlight--;
+			if (!sendRest)
+			{
+				target->nextBatch = _batchCount;
+			}
+			else if (target->nextBatch < _batchCount)
+			{
+				sendBatches(target);
+			}
+			return;
+		}
+	}
+}
+
+bool SNMPSet::sendTo(IPAddress *ips, int count)
+{
+	bool sent = true;
+	for (int i = 0; i < count; i++)
+	{
+		sent = sendTo(ips[i]) && sent;
+	}
+	return sent;
+}
+
+bool SNMPSet::onResponse(IPAddress ip, unsigned long requestID, int errorStatus, int errorIndex, uint8_t tag)
+{
+	// errorIndex is relative to the packet, convert it to the position in the full list
+	int index = (errorIndex > 0 && tag < _batchCount) ? _batchFirstIndex[tag] + errorIndex - 1 : 0;
+#ifdef DEBUG
+	Serial.print(F("[DEBUG] SNMPSet: Response from: "));
+	Serial.print(ip);
+	Serial.print(F(" - Error Status: "));
+	Serial.print(errorStatus);
+	Serial.print(F(" - Error Index: "));
+	Serial.println(index);
+#endif
+	if (_responseCallback)
+	{
+		_responseCallback(ip, errorStatus, index, index ? callbackAt(index) : 0);
+	}
+	batchEnded(ip, true);
+	return true; // The varbinds echo the values written, so there is nothing to pass on to the handlers
+}
+
+void SNMPSet::onTimeout(IPAddress ip, unsigned long requestID, uint8_t tag)
+{
+	if (_responseCallback)
+	{
+		_responseCallback(ip, SNMP_ERROR_TIMEOUT, 0, 0);
+	}
+	batchEnded(ip, true);
+}
+
+void SNMPSet::onCancelled(IPAddress ip, unsigned long requestID, uint8_t tag)
+{
+	if (_responseCallback)
+	{
+		_responseCallback(ip, SNMP_ERROR_CANCELLED, 0, 0);
+	}
+	batchEnded(ip, false);
+}
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef SNMPSnapshot_h
+#define SNMPSnapshot_h
+
+#ifndef SNMP_SNAPSHOT_STAGING
+#define SNMP_SNAPSHOT_STAGING 256 // Bytes of values from one response held back until it is committed, when SNMP_SNAPSHOTS is defined
+#endif
+
+#ifndef SNMP_SEQLOCK_SPINS
+#define SNMP_SEQLOCK_SPINS 64 // Times a reader checks for the end of a write before yielding to other tasks between checks
+#endif
+
+// Sequence lock over the handler destinations. The manager makes the sequence odd while it writes values and even again once it
+// has finished, so a reader on another core or task copies the values it needs between readBegin() and readRetry(), and tries
+// again if they were written meanwhile. The writer never waits for readers. Readers must not be interrupt handlers, as they wait
+// for a write under way to finish, which it can't while the interrupt is running on the same core.
+class SNMPSeqLock
+{
+public:
+    void writeBegin()
+    {
+        __atomic_store_n(&_sequence, _sequence + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    void writeEnd()
+    {
+        __atomic_store_n(&_sequence, _sequence + 1, __ATOMIC_RELEASE);
+    }
+
+    uint32_t readBegin()
+    {
+        uint32_t sequence;
+        uint16_t spins = 0;
+        while ((sequence = __atomic_load_n(&_sequence, __ATOMIC_ACQUIRE)) & 1)
+        {
+            // A write is under way. Copying the values is quick, but a response that overflowed the stage is held open while it
+            // is decoded, and the writer may need this core to finish.
+            if (spins < SNMP_SEQLOCK_SPINS)
+            {
+                spins++;
+            }
+            else
+            {
+                yield();
+            }
+        }
+        return sequence;
+    }
+
+    bool readRetry(uint32_t sequence)
+    {
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        return __atomic_load_n(&_sequence, __ATOMIC_RELAXED) != sequence;
+    }
+
+private:
+    uint32_t _sequence = 0;
+};
+
+// Values of a response waiting to be written to their handlers' destinations, each after the handler it belongs to.
+class SNMPValueStage
+{
+public:
+    // Returns false if there is no room left
+    bool add(ValueCallback *callback, const void *value, uint16_t size)
+    {
+        uint16_t length = entryLength(size);
+        if (_used + length > SNMP_SNAPSHOT_STAGING)
+        {
+            return false;
+        }
+        Entry *entry = (Entry *)(_data + _used);
+        entry->callback = callback;
+        entry->size = size;
+        memcpy(entry + 1, value, size);
+        _used += length;
+        return true;
+    }
+
+    bool isEmpty()
+    {
+        return !_used;
+    }
+
+    // Writes the values to their destinations, in the order they were added. Values of removed handlers are skipped, their value
+    // pointer then links the free handlers.
+    void write()
+    {
+        for (uint16_t offset = 0; offset < _used; offset += entryLength(((Entry *)(_data + offset))->size))
+        {
+            Entry *entry = (Entry *)(_data + offset);
+            ValueCallback *callback = entry->callback;
+            if (callback && callback->agent)
+            {
+                memcpy(callback->type == STRING ? *(char **)callback->value : callback->value, entry + 1, entry->size);
+            }
+        }
+    }
+
+    // The handlers of the values still registered, in the order they were added
+    ValueCallback *callbackAt(uint16_t *offset)
+    {
+        while (*offset < _used)
+        {
+            Entry *entry = (Entry *)(_data + *offset);
+            *offset += entryLength(entry->size);
+            if (entry->callback && entry->callback->agent)
+            {
+                return entry->callback;
+            }
+        }
+        return 0;
+    }
+
+    // Forgets the values of handlers removed since they were added, before the handlers can be reused or freed
+    void dropRemoved()
+    {
+        for (uint16_t offset = 0; offset < _used; offset += entryLength(((Entry *)(_data + offset))->size))
+        {
+            Entry *entry = (Entry *)(_data + offset);
+            if (entry->callback && !entry->callback->agent)
+            {
+                entry->callback = 0;
+            }
+        }
+    }
+
+    void clear()
+    {
+        _used = 0;
+    }
+
+private:
+    struct Entry
+    {
+        ValueCallback *callback;
+        uint16_t size;
+    };
+    // Entries start on pointer boundaries so the values after them can be copied out as any type
+    alignas(void *) unsigned char _data[SNMP_SNAPSHOT_STAGING];
+    uint16_t _used = 0;
+
+    static uint16_t entryLength(uint16_t size)
+    {
+        return (sizeof(Entry) + size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    }
+};
+
+#endif
@@ -0,0 +1,547 @@
+#ifndef SNMPTable_h
+#define SNMPTable_h
+
+#ifndef SNMP_MAX_TABLE_COLUMNS
+#define SNMP_MAX_TABLE_COLUMNS 8 // Columns one SNMPTable can hold
+#endif
+
+#ifndef SNMP_TABLE_MAX_REPETITIONS
+#define SNMP_TABLE_MAX_REPETITIONS 8 // Rows asked for in each GetBulkRequest, until the agent's own limit has been learned
+#endif
+
+class SNMPTable;
+
+// Called when a walk ends, ok is false if it was stopped by an error response or a timeout.
+typedef void (*TableWalkCallback)(SNMPTable *table, bool ok);
+
+// Selected columns of a table indexed by a single integer, such as ifTable, walked from one agent into one array per column.
+// Rows are kept in index order and row r of each column belongs to the same table row, so a column can be summed in a tight loop.
+// For a registered agent the rows asked for in each GetBulkRequest are tuned from the size of its responses, to fill
+// SNMP_PACKET_LENGTH without going over, and halved whenever it answers tooBig.
+class SNMPTable : public SNMPRequestOwner
+{
+public:
+    SNMPTable(const char *community, short version, uint16_t maxRows) : _community(community), _version(version), _maxRows(maxRows)
+    {
+        _rowIndex = (uint32_t *)malloc(maxRows * sizeof(uint32_t));
+        _rowGeneration = (uint16_t *)malloc(maxRows * sizeof(uint16_t));
+        _nextRequestID = random(0x7FFF) + 1;
+    };
+    ~SNMPTable()
+    {
+        if (_manager)
+        {
+            _manager->cancelRequests(this);
+        }
+        for (uint8_t i = 0; i < _columnCount; i++)
+        {
+            free(_columns[i].data);
+        }
+        free(_rowIndex);
+        free(_rowGeneration);
+    };
+    const char *_community;
+    short _version;
+    short port = 161;
+
+    // The OID of the table's entry, e.g. ".1.3.6.1.2.1.2.2.1" for ifEntry.
+    bool setEntry(const char *entryOID)
+    {
+        _entryLength = berEncodeOID(entryOID, _entry, SNMP_MAX_OID_BYTES);
+        return _entryLength > 0;
+    }
+
+    // Adds column number column of the entry, returning its position for the accessors below, or -1.
+    // INTEGER, COUNTER32, GAUGE32, TIMESTAMP, COUNTER64 and STRING columns can be stored, strings up to length - 1 characters.
+    int addColumn(uint32_t column, ASN_TYPE type, uint8_t length = 0);
+
+    void setPort(short portnumber)
+    {
+        port = portnumber;
+    }
+
+    void setUDP(UDP *udp)
+    {
+        _udp = udp;
+    }
+
+    // Required, the responses to a walk's requests are passed back through the manager.
+    void setManager(SNMPManager *manager)
+    {
+        _manager = manager;
+    }
+
+    // Send as SNMPv3 using the security settings of the engine, the community and version are then ignored.
+    void setEngine(SNMPv3Engine *engine)
+    {
+        _engine = engine;
+    }
+
+    void setMaxRepetitions(uint8_t repetitions)
+    {
+        _maxRepetitions = repetitions;
+    }
+
+    void setWalkCallback(TableWalkCallback callback)
+    {
+        _walkCallback = callback;
+    }
+
+    // Starts walking the columns, using GetBulkRequests (GetNextRequests for SNMPv1). Returns false if it couldn't be started.
+    bool walk(IPAddress ip);
+    // Walk using the version, community, port and engine registered for the agent, rather than this table's own.
+    bool walk(SNMPAgent *agent);
+
+    bool isWalking()
+    {
+        return _walking;
+    }
+
+    // Incremented at the start of each walk. A row whose generation differs wasn't seen in the latest walk.
+    uint16_t generation()
+    {
+        return _generation;
+    }
+
+    uint16_t rowCount()
+    {
+        return _rowCount;
+    }
+
+    uint32_t rowIndex(uint16_t row)
+    {
+        return _rowIndex[row];
+    }
+
+    uint16_t rowGeneration(uint16_t row)
+    {
+        return _rowGeneration[row];
+    }
+
+    // Row for an index, or -1
+    int findRow(uint32_t index);
+
+    // The values of a column, rowCount() long, or 0 if the column holds another type.
+    int32_t *int32Column(int column)
+    {
+        return (column < _columnCount && _columns[column].type == INTEGER) ? (int32_t *)_columns[column].data : 0;
+    }
+    uint32_t *uint32Column(int column)
+    {
+        return (column < _columnCount && (_columns[column].type == COUNTER32 || _columns[column].type == GAUGE32 || _columns[column].type == TIMESTAMP)) ? (uint32_t *)_columns[column].data : 0;
+    }
+    uint64_t *uint64Column(int column)
+    {
+        return (column < _columnCount && _columns[column].type == COUNTER64) ? (uint64_t *)_columns[column].data : 0;
+    }
+    const char *stringAt(int column, uint16_t row)
+    {
+        return (column < _columnCount && _columns[column].type == STRING && row < _rowCount) ? (char *)_columns[column].data + row * _columns[column].size : 0;
+    }
+
+    bool onResponse(IPAddress ip, unsigned long requestID, int errorStatus, int errorIndex, uint8_t tag);
+    void onTimeout(IPAddress ip, unsigned long requestID, uint8_t tag);
+    bool onResponseVarBind(IPAddress ip, const unsigned char *oid, uint8_t oidLength, BER_CONTAINER *value, uint8_t tag);
+    void onResponseComplete(IPAddress ip, uint8_t tag);
+
+private:
+    struct Column
+    {
+        uint32_t number;
+        ASN_TYPE type;
+        uint8_t size; // Bytes per row
+        void *data;
+        uint32_t lastIndex; // Index of the last row walked
+        bool started;
+        bool done;
+    };
+
+    UDP *_udp = 0;
+    SNMPManager *_manager = 0;
+    SNMPv3Engine *_engine = 0;
+    TableWalkCallback _walkCallback = 0;
+    unsigned char _entry[SNMP_MAX_OID_BYTES];
+    uint8_t _entryLength = 0;
+    Column _columns[SNMP_MAX_TABLE_COLUMNS];
+    uint8_t _columnCount = 0;
+    uint16_t _maxRows;
+    uint16_t _rowCount = 0;
+    uint32_t *_rowIndex;
+    uint16_t *_rowGeneration;
+    uint16_t _generation = 0;
+    uint8_t _maxRepetitions = SNMP_TABLE_MAX_REPETITIONS;
+
+    // The walk in progress
+    bool _walking = false;
+    IPAddress _walkIP;
+    uint16_t _walkPort;
+    const char *_walkCommunity;
+    short _walkVersion;
+    SNMPv3Engine *_walkEngine;
+    unsigned long _nextRequestID;
+    uint8_t _requestColumns[SNMP_MAX_TABLE_COLUMNS]; // Columns asked for by the request in flight, in varbind order
+    uint8_t _requestColumnCount;
+    unsigned int _varBindCount;    // Varbinds of the response so far
+    uint8_t _requestRepetitions;   // Max-repetitions of the request in flight
+    unsigned int _requestOverhead; // Bytes of the request in flight outside its varbinds
+
+    bool start(IPAddress ip, uint16_t toPort, const char *community, short version, SNMPv3Engine *engine);
+    bool sendNext();
+    void finish(bool ok);
+    int insertRow(uint32_t index);
+    void store(Column *column, uint16_t row, BER_CONTAINER *value);
+};
+
+int SNMPTable::addColumn(uint32_t column, ASN_TYPE type, uint8_t length)
+{
+    uint8_t size;
+    switch (type)
+    {
+    case INTEGER:
+    case COUNTER32:
+    case GAUGE32:
+    case TIMESTAMP:
+        size = sizeof(uint32_t);
+        break;
+    case COUNTER64:
+        size = sizeof(uint64_t);
+        break;
+    case STRING:
+        size = length;
+        break;
+    default:
+        size = 0;
+        break;
+    }
+    if (!size || _columnCount >= SNMP_MAX_TABLE_COLUMNS || _walking || !_rowIndex || !_rowGeneration)
+    {
+        return -1;
+    }
+    void *data = calloc(_maxRows, size);
+    if (!data)
+    {
+        return -1;
+    }
+    Column *added = &_columns[_columnCount];
+    added->number = column;
+    added->type = type;
+    added->size = size;
+    added->data = data;
+    _rowCount = 0; // Rows already walked don't have the new column
+    return _columnCount++;
+}
+
+bool SNMPTable::walk(IPAddress ip)
+{
+    return start(ip, port, _community, _version, _engine);
+}
+
+bool SNMPTable::walk(SNMPAgent *agent)
+{
+    if (!agent)
+    {
+        return false;
+    }
+    short version = agent->version == SNMP_VERSION_UNSET ? _version : agent->version;
+    return start(agent->ip, agent->port, agent->community ? agent->community : _community, version, agent->engine);
+}
+
+bool SNMPTable::start(IPAddress ip, uint16_t toPort, const char *community, short version, SNMPv3Engine *engine)
+{
+    if (_walking || !_udp || !_manager || !_columnCount || !_entryLength || !_manager->canSend(ip))
+    {
+        return false;
+    }
+    if (engine && !engine->isDiscovered())
+    {
+        // The agent's engine ID, boots and time are needed before an authenticated request can be sent
+        unsigned char discovery[SNMP_V3_HEADER_RESERVE];
+        int length = engine->discoveryMessage(discovery, SNMP_V3_HEADER_RESERVE, _nextRequestID);
+        if (length)
+        {
+            _udp->beginPacket(ip, toPort);
+            _udp->write(discovery, length);
+            _udp->endPacket();
+        }
+        return false;
+    }
+    _walkIP = ip;
+    _walkPort = toPort;
+    _walkCommunity = community;
+    _walkVersion = version;
+    _walkEngine = engine;
+    for (uint8_t i = 0; i < _columnCount; i++)
+    {
+        _columns[i].started = false;
+        _columns[i].done = false;
+    }
+    _generation++;
+    _walking = true;
+    return sendNext();
+}
+
+bool SNMPTable::sendNext()
+{
+    // Each column continues from the last row it returned, so columns with gaps or different lengths are walked correctly
+    unsigned int varBindsLength = 0;
+    _requestColumnCount = 0;
+    for (uint8_t i = 0; i < _columnCount; i++)
+    {
+        Column *column = &_columns[i];
+        if (column->done)
+        {
+            continue;
+        }
+        unsigned int oidLength = _entryLength + berArcLength(column->number) + (column->started ? berArcLength(column->lastIndex) : 0);
+        varBindsLength += 2 + 2 + oidLength + 2;
+        _requestColumns[_requestColumnCount++] = i;
+    }
+    SNMPBuffer buffer(32 + (_walkEngine ? SNMP_V3_HEADER_RESERVE : strlen(_walkCommunity)) + varBindsLength);
+    if (!buffer.data)
+    {
+        finish(false);
+        return false;
+    }
+    unsigned long requestID = _nextRequestID;
+    _nextRequestID = (_nextRequestID % 0x7FFFFFFF) + 1;
+    ASN_TYPE pduType = _walkVersion == 0 ? GetNextRequestPDU : GetBulkRequestPDU;
+    SNMPAgent *agent = _manager->findAgent(_walkIP);
+    _requestRepetitions = agent && agent->maxRepetitions ? agent->maxRepetitions : _maxRepetitions;
+    int maxRepetitions = _walkVersion == 0 ? 0 : _requestRepetitions; // Non-repeaters is left at 0
+    unsigned char *ptr = buffer.data + (_walkEngine ? SNMP_V3_HEADER_RESERVE : 0);
+    unsigned char *pdu = ptr;
+    if (_walkEngine)
+    {
+        ptr += berWritePDUHeader(ptr, pduType, requestID, varBindsLength, 0, maxRepetitions);
+    }
+    else
+    {
+        ptr += berWriteMessageHeader(ptr, _walkCommunity, _walkVersion, pduType, requestID, varBindsLength, 0, maxRepetitions);
+    }
+    for (uint8_t i = 0; i < _requestColumnCount; i++)
+    {
+        Column *column = &_columns[_requestColumns[i]];
+        unsigned int oidLength = _entryLength + berArcLength(column->number) + (column->started ? berArcLength(column->lastIndex) : 0);
+        *ptr++ = STRUCTURE;
+        *ptr++ = 2 + oidLength + 2;
+        *ptr++ = ASN_TYPE::OID;
+        *ptr++ = oidLength;
+        memcpy(ptr, _entry, _entryLength);
+        ptr += _entryLength;
+        ptr += berEncodeArc(column->number, ptr);
+        if (column->started)
+        {
+            ptr += berEncodeArc(column->lastIndex, ptr);
+        }
+        *ptr++ = NULLTYPE;
+        *ptr++ = 0;
+    }
+    int length = ptr - buffer.data;
+    if (_walkEngine)
+    {
+        length = _walkEngine->wrap(pdu, ptr - pdu, buffer.data, buffer.size);
+    }
+    if (!length || !_manager->trackRequest(_walkIP, requestID, this))
+    {
+        finish(false);
+        return false;
+    }
+#ifdef DEBUG
+    Serial.print(F("[DEBUG] SNMPTable: Sending UDP packet to: "));
+    Serial.println(_walkIP);
+#endif
+    _varBindCount = 0;
+    _requestOverhead = length - varBindsLength;
+    _udp->beginPacket(_walkIP, _walkPort);
+    _udp->write(buffer.data, length);
+    _udp->endPacket();
+    return true;
+}
+
+void SNMPTable::finish(bool ok)
+{
+    _walking = false;
+    if (_walkCallback)
+    {
+        _walkCallback(this, ok);
+    }
+}
+
+int SNMPTable::findRow(uint32_t index)
+{
+    int low = 0;
+    int high = _rowCount - 1;
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+        if (_rowIndex[middle] == index)
+        {
+            return middle;
+        }
+        if (_rowIndex[middle] < index)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return -1;
+}
+
+int SNMPTable::insertRow(uint32_t index)
+{
+    // Rows arrive in index order, so a new row is nearly always appended rather than moving the rows after it
+    int row = _rowCount;
+    while (row > 0 && _rowIndex[row - 1] > index)
+    {
+        row--;
+    }
+    if (_rowCount >= _maxRows)
+    {
+        return -1;
+    }
+    int moved = _rowCount - row;
+    memmove(&_rowIndex[row + 1], &_rowIndex[row], moved * sizeof(uint32_t));
+    memmove(&_rowGeneration[row + 1], &_rowGeneration[row], moved * sizeof(uint16_t));
+    for (uint8_t i = 0; i < _columnCount; i++)
+    {
+        unsigned char *data = (unsigned char *)_columns[i].data;
+        uint8_t size = _columns[i].size;
+        memmove(data + (row + 1) * size, data + row * size, moved * size);
+        memset(data + row * size, 0, size);
+    }
+    _rowIndex[row] = index;
+    _rowCount++;
+    return row;
+}
+
+void SNMPTable::store(Column *column, uint16_t row, BER_CONTAINER *value)
+{
+    void *data = (unsigned char *)column->data + row * column->size;
+    switch (column->type)
+    {
+    case INTEGER:
+        *(int32_t *)data = ((IntegerType *)value)->_value;
+        break;
+    case COUNTER32:
+    case GAUGE32:
+    case TIMESTAMP:
+        *(uint32_t *)data = ((IntegerType *)value)->_value;
+        break;
+    case COUNTER64:
+        *(uint64_t *)data = ((Counter64 *)value)->_value;
+        break;
+    case STRING:
+        strncpy((char *)data, ((OctetType *)value)->_value, column->size - 1);
+        ((char *)data)[column->size - 1] = 0;
+        break;
+    default:
+        break;
+    }
+}
+
+bool SNMPTable::onResponse(IPAddress ip, unsigned long requestID, int errorStatus, int errorIndex, uint8_t tag)
+{
+    if (errorStatus == SNMP_ERROR_TOO_BIG && _walkVersion != 0 && _requestRepetitions > 1)
+    {
+        // Ask again for half as many rows, and remember it for the agent
+        SNMPAgent *agent = _manager->findAgent(ip);
+        if (agent)
+        {
+            agent->maxRepetitions = _requestRepetitions / 2;
+        }
+        else
+        {
+            _maxRepetitions = _requestRepetitions / 2;
+        }
+        sendNext();
+        return true;
+    }
+    if (errorStatus)
+    {
+        // SNMPv1 agents answer a GetNextRequest past the end of the MIB with noSuchName
+        finish(_walkVersion == 0 && errorStatus == 2);
+        return true;
+    }
+    return false; // Have the varbinds passed to onResponseVarBind
+}
+
+bool SNMPTable::onResponseVarBind(IPAddress ip, const unsigned char *oid, uint8_t oidLength, BER_CONTAINER *value, uint8_t tag)
+{
+    if (!_requestColumnCount)
+    {
+        return true;
+    }
+    // GetBulk returns the next row of each requested column in turn, the varbinds are in the order of the request's
+    Column *column = &_columns[_requestColumns[_varBindCount++ % _requestColumnCount]];
+    if (column->done)
+    {
+        return true;
+    }
+    uint32_t arcs[2];
+    if (oidLength <= _entryLength || memcmp(oid, _entry, _entryLength) != 0 || berDecodeArcs(oid + _entryLength, oidLength - _entryLength, arcs, 2) != 2 || arcs[0] != column->number || (column->started && arcs[1] <= column->lastIndex) || value->_type == ENDOFMIBVIEW)
+    {
+        // Walked past the end of the column
+        column->done = true;
+        return true;
+    }
+    column->lastIndex = arcs[1];
+    column->started = true;
+    if (value->_type != column->type)
+    {
+        return true;
+    }
+    int row = findRow(arcs[1]);
+    if (row < 0)
+    {
+        row = insertRow(arcs[1]);
+        if (row < 0)
+        {
+            column->done = true; // No room for more rows
+            return true;
+        }
+    }
+    store(column, row, value);
+    _rowGeneration[row] = _generation;
+    return true;
+}
+
+void SNMPTable::onResponseComplete(IPAddress ip, uint8_t tag)
+{
+    if (!_walking)
+    {
+        return;
+    }
+    SNMPAgent *agent = _manager->findAgent(ip);
+    unsigned int rows = _requestColumnCount ? _varBindCount / _requestColumnCount : 0;
+    if (agent && _walkVersion != 0 && rows && _manager->responseLength() > _requestOverhead)
+    {
+        // The response is taken to have about the request's overhead, the rest being rows of the same size.
+        // Learned once and then only lowered, so it never climbs back to a size the agent answered tooBig.
+        unsigned int rowLength = (_manager->responseLength() - _requestOverhead + rows - 1) / rows;
+        unsigned int fit = SNMP_PACKET_LENGTH > _requestOverhead ? (SNMP_PACKET_LENGTH - _requestOverhead) / rowLength : 1;
+        fit = fit < 1 ? 1 : fit > SNMP_AGENT_MAX_REPETITIONS ? SNMP_AGENT_MAX_REPETITIONS : fit;
+        if (!agent->maxRepetitions || fit < agent->maxRepetitions)
+        {
+            agent->maxRepetitions = fit;
+        }
+    }
+    for (uint8_t i = 0; i < _columnCount; i++)
+    {
+        if (!_columns[i].done)
+        {
+            sendNext();
+            return;
+        }
+    }
+    finish(true);
+}
+
+void SNMPTable::onTimeout(IPAddress ip, unsigned long requestID, uint8_t tag)
+{
+    finish(false);
+}
+
+#endif
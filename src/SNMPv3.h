@@ -0,0 +1,487 @@
+#ifndef SNMPv3_h
+#define SNMPv3_h
+
+#include "SNMPCrypto.h"
+
+#define SNMP_VERSION_3 3
+#define SNMP_V3_SECURITY_MODEL_USM 3
+#define SNMP_V3_AUTH_PARAMS_LENGTH 12 // HMAC-MD5-96 and HMAC-SHA-96 are truncated to 12 bytes
+#define SNMP_V3_PRIV_PARAMS_LENGTH 8
+#define SNMP_V3_HEADER_RESERVE 128 // Room for the v3 message header and security parameters in front of a PDU
+#define SNMP_V3_TIME_WINDOW 150    // Seconds an authenticated message may be behind the agent's clock (RFC 3414)
+#define SNMP_V3_MAX_BOOTS 2147483647
+
+#define SNMP_V3_FLAG_AUTH 0x01
+#define SNMP_V3_FLAG_PRIV 0x02
+#define SNMP_V3_FLAG_REPORTABLE 0x04
+
+#ifndef SNMP_V3_MAX_ENGINE_ID_LENGTH
+#define SNMP_V3_MAX_ENGINE_ID_LENGTH 32
+#endif
+
+inline bool snmpIsV3Message(const unsigned char *buf, int length)
+{
+    // SEQUENCE, then INTEGER version 3
+    if (length < 8 || buf[0] != STRUCTURE)
+    {
+        return false;
+    }
+    int offset = (buf[1] & 0x80) ? 2 + (buf[1] & 0x7F) : 2;
+    return buf[offset] == INTEGER && buf[offset + 1] == 1 && buf[offset + 2] == SNMP_VERSION_3;
+}
+
+class SNMPv3User
+{
+public:
+    SNMPv3User(const char *userName, SNMPAuthProtocol authProtocol = SNMP_AUTH_NONE, const char *authPassword = 0, SNMPPrivProtocol privProtocol = SNMP_PRIV_NONE, const char *privPassword = 0)
+        : _userName(userName), _authProtocol(authProtocol), _authPassword(authPassword), _privProtocol(authProtocol == SNMP_AUTH_NONE ? SNMP_PRIV_NONE : privProtocol), _privPassword(privPassword)
+    {
+        // RFC 3414 requires passwords of at least 8 characters, shorter ones are refused rather than hashed
+        _valid = (_authProtocol == SNMP_AUTH_NONE || validPassword(_authPassword)) && (_privProtocol == SNMP_PRIV_NONE || validPassword(_privPassword));
+    };
+    const char *_userName;
+    SNMPAuthProtocol _authProtocol;
+    const char *_authPassword;
+    SNMPPrivProtocol _privProtocol;
+    const char *_privPassword;
+
+    // False if a password needed by the protocols is shorter than 8 characters, nothing is then sent or accepted for the user
+    bool isValid()
+    {
+        return _valid;
+    }
+
+    uint8_t securityFlags()
+    {
+        return (_authProtocol != SNMP_AUTH_NONE ? SNMP_V3_FLAG_AUTH : 0) | (_privProtocol != SNMP_PRIV_NONE ? SNMP_V3_FLAG_PRIV : 0);
+    }
+
+    // Master keys (Ku) from the passwords. Each needs a megabyte of hashing, so they are computed on first use and
+    // shared by every agent this user talks to.
+    const uint8_t *authKey()
+    {
+        computeKeys();
+        return _authKey;
+    }
+
+    const uint8_t *privKey()
+    {
+        computeKeys();
+        return _privKey;
+    }
+
+private:
+    uint8_t _authKey[SNMP_MAX_DIGEST_SIZE];
+    uint8_t _privKey[SNMP_MAX_DIGEST_SIZE];
+    bool _keysComputed = false;
+    bool _valid;
+
+    static bool validPassword(const char *password)
+    {
+        return password && strlen(password) >= 8;
+    }
+
+    void computeKeys()
+    {
+        if (_keysComputed)
+        {
+            return;
+        }
+#ifdef DEBUG
+        unsigned long start = millis();
+#endif
+        if (_authProtocol != SNMP_AUTH_NONE)
+        {
+            snmpPasswordToKey(_authProtocol, _authPassword, _authKey);
+        }
+        if (_privProtocol != SNMP_PRIV_NONE)
+        {
+            // The privacy key is derived with the authentication hash
+            snmpPasswordToKey(_authProtocol, _privPassword, _privKey);
+        }
+        _keysComputed = true;
+#ifdef DEBUG
+        Serial.print(F("[DEBUG] SNMPv3 password to key took (ms): "));
+        Serial.println(millis() - start);
+#endif
+    }
+};
+
+// State held for each authoritative engine (agent): its engine ID, boots and time, and the user's keys localised to
+// that engine ID. The localised HMAC pad state and expanded AES key are kept so each message only pays for hashing
+// and encrypting its own bytes.
+class SNMPv3Engine
+{
+public:
+    SNMPv3Engine(IPAddress agentIP, SNMPv3User *user) : ip(agentIP), _user(user)
+    {
+        _msgID = random(0x7FFF) + 1;
+        _salt = random(0x7FFFFFFF);
+    };
+    IPAddress ip;
+    SNMPv3User *_user;
+
+    uint8_t _engineID[SNMP_V3_MAX_ENGINE_ID_LENGTH];
+    uint8_t _engineIDLength = 0;
+    long _engineBoots = 0;
+    long _engineTime = 0;
+    unsigned long _timeSyncedAt = 0;
+    long _latestReceivedTime = 0; // Highest engine time received for the current boots
+
+    bool isDiscovered()
+    {
+        return _engineIDLength > 0;
+    }
+    // Forgets the engine ID, so the next request discovers it again. Reports are only trusted until an engine ID is known, so
+    // this is needed after the agent is replaced or its engine ID is changed.
+    void rediscover()
+    {
+        _engineIDLength = 0;
+        _engineBoots = 0;
+        _engineTime = 0;
+        _latestReceivedTime = 0;
+    }
+
+    int discoveryMessage(unsigned char *buf, int bufSize, long requestID);
+    int wrap(const unsigned char *pdu, int pduLength, unsigned char *buf, int bufSize);
+    int unwrap(unsigned char *buf, int length, unsigned char **pdu);
+
+private:
+    SNMPHmac _hmac;
+    SNMPAes128 _aes;
+    long _msgID;
+    uint64_t _salt;
+
+    long engineTime()
+    {
+        return _engineTime + (millis() - _timeSyncedAt) / 1000;
+    }
+    void localizeKeys();
+    int build(const unsigned char *pdu, int pduLength, unsigned char *buf, int bufSize, bool discovery);
+};
+
+void SNMPv3Engine::localizeKeys()
+{
+    uint8_t localizedKey[SNMP_MAX_DIGEST_SIZE];
+    if (_user->_authProtocol != SNMP_AUTH_NONE)
+    {
+        snmpLocalizeKey(_user->_authProtocol, _user->authKey(), _engineID, _engineIDLength, localizedKey);
+        _hmac.setKey(_user->_authProtocol, localizedKey, snmpDigestSize(_user->_authProtocol));
+    }
+    if (_user->_privProtocol == SNMP_PRIV_AES)
+    {
+        snmpLocalizeKey(_user->_authProtocol, _user->privKey(), _engineID, _engineIDLength, localizedKey);
+        _aes.setKey(localizedKey); // AES-128 uses the first 16 bytes
+    }
+}
+
+int SNMPv3Engine::discoveryMessage(unsigned char *buf, int bufSize, long requestID)
+{
+    if (!_user->isValid())
+    {
+        Serial.println(F("SNMPv3 passwords must be at least 8 characters"));
+        return 0;
+    }
+    // An unauthenticated, reportable GetRequest with no varbinds, answered with a Report carrying the engine ID, boots and time
+    unsigned char pdu[16];
+    unsigned char *ptr = pdu;
+    *ptr++ = GetRequestPDU;
+    unsigned char *lengthPtr = ptr++;
+    ptr += berWriteInteger(ptr, INTEGER, requestID);
+    ptr += berWriteInteger(ptr, INTEGER, 0);
+    ptr += berWriteInteger(ptr, INTEGER, 0);
+    *ptr++ = STRUCTURE;
+    *ptr++ = 0;
+    *lengthPtr = ptr - pdu - 2;
+    return build(pdu, ptr - pdu, buf, bufSize, true);
+}
+
+int SNMPv3Engine::wrap(const unsigned char *pdu, int pduLength, unsigned char *buf, int bufSize)
+{
+    if (!isDiscovered() || !_user->isValid())
+    {
+        return 0;
+    }
+    return build(pdu, pduLength, buf, bufSize, false);
+}
+
+int SNMPv3Engine::build(const unsigned char *pdu, int pduLength, unsigned char *buf, int bufSize, bool discovery)
+{
+    uint8_t flags = SNMP_V3_FLAG_REPORTABLE | (discovery ? 0 : _user->securityFlags());
+    bool auth = flags & SNMP_V3_FLAG_AUTH;
+    bool priv = flags & SNMP_V3_FLAG_PRIV;
+    int engineIDLength = discovery ? 0 : _engineIDLength;
+    int userLength = discovery ? 0 : strlen(_user->_userName);
+    int authLength = auth ? SNMP_V3_AUTH_PARAMS_LENGTH : 0;
+    int privLength = priv ? SNMP_V3_PRIV_PARAMS_LENGTH : 0;
+    long boots = discovery ? 0 : _engineBoots;
+    long time = discovery ? 0 : engineTime();
+    _msgID = (_msgID % 0x7FFFFFFF) + 1;
+
+    // Integers are encoded up front as their lengths feed into the enclosing lengths
+    unsigned char msgIDBuf[6], maxSizeBuf[6], bootsBuf[6], timeBuf[6];
+    int msgIDLength = berWriteInteger(msgIDBuf, INTEGER, _msgID);
+    int maxSizeLength = berWriteInteger(maxSizeBuf, INTEGER, SNMP_PACKET_LENGTH);
+    int bootsLength = berWriteInteger(bootsBuf, INTEGER, boots);
+    int timeLength = berWriteInteger(timeBuf, INTEGER, time);
+
+    int scopedContent = 2 + engineIDLength + 2 + pduLength;
+    int scopedLength = 1 + berLengthSize(scopedContent) + scopedContent;
+    int msgDataLength = priv ? 1 + berLengthSize(scopedLength) + scopedLength : scopedLength;
+    int securityContent = 2 + engineIDLength + bootsLength + timeLength + 2 + userLength + 2 + authLength + 2 + privLength;
+    int securitySequence = 1 + berLengthSize(securityContent) + securityContent;
+    int globalContent = msgIDLength + maxSizeLength + 3 + 3;
+    int messageContent = 3 + 1 + berLengthSize(globalContent) + globalContent + 1 + berLengthSize(securitySequence) + securitySequence + msgDataLength;
+    int total = 1 + berLengthSize(messageContent) + messageContent;
+    if (total > bufSize)
+    {
+        return 0;
+    }
+    // Move the PDU into place first, the caller may have serialised it into the same buffer
+    memmove(buf + total - pduLength, pdu, pduLength);
+
+    unsigned char *ptr = buf;
+    *ptr++ = STRUCTURE;
+    ptr += berWriteLength(ptr, messageContent);
+    ptr += berWriteInteger(ptr, INTEGER, SNMP_VERSION_3);
+    *ptr++ = STRUCTURE;
+    ptr += berWriteLength(ptr, globalContent);
+    memcpy(ptr, msgIDBuf, msgIDLength);
+    ptr += msgIDLength;
+    memcpy(ptr, maxSizeBuf, maxSizeLength);
+    ptr += maxSizeLength;
+    *ptr++ = STRING;
+    *ptr++ = 1;
+    *ptr++ = flags;
+    ptr += berWriteInteger(ptr, INTEGER, SNMP_V3_SECURITY_MODEL_USM);
+
+    *ptr++ = STRING; // msgSecurityParameters, a BER encoded UsmSecurityParameters in an OCTET STRING
+    ptr += berWriteLength(ptr, securitySequence);
+    *ptr++ = STRUCTURE;
+    ptr += berWriteLength(ptr, securityContent);
+    *ptr++ = STRING;
+    *ptr++ = engineIDLength;
+    memcpy(ptr, _engineID, engineIDLength);
+    ptr += engineIDLength;
+    memcpy(ptr, bootsBuf, bootsLength);
+    ptr += bootsLength;
+    memcpy(ptr, timeBuf, timeLength);
+    ptr += timeLength;
+    *ptr++ = STRING;
+    *ptr++ = userLength;
+    memcpy(ptr, _user->_userName, userLength);
+    ptr += userLength;
+    *ptr++ = STRING;
+    *ptr++ = authLength;
+    unsigned char *authPtr = ptr;
+    memset(ptr, 0, authLength); // zeroed while the HMAC is calculated
+    ptr += authLength;
+    *ptr++ = STRING;
+    *ptr++ = privLength;
+    unsigned char *privPtr = ptr;
+    ptr += privLength;
+
+    if (priv)
+    {
+        *ptr++ = STRING;
+        ptr += berWriteLength(ptr, scopedLength);
+    }
+    unsigned char *scopedPtr = ptr;
+    *ptr++ = STRUCTURE;
+    ptr += berWriteLength(ptr, scopedContent);
+    *ptr++ = STRING; // contextEngineID
+    *ptr++ = engineIDLength;
+    memcpy(ptr, _engineID, engineIDLength);
+    ptr += engineIDLength;
+    *ptr++ = STRING; // contextName, default context
+    *ptr++ = 0;
+
+    if (priv)
+    {
+        // RFC 3826: IV is boots, time and the 64 bit salt sent as msgPrivacyParameters
+        uint8_t iv[SNMP_AES_BLOCK_SIZE];
+        _salt++;
+        for (int i = 0; i < 4; i++)
+        {
+            iv[i] = boots >> (24 - i * 8);
+            iv[4 + i] = time >> (24 - i * 8);
+        }
+        for (int i = 0; i < 8; i++)
+        {
+            privPtr[i] = _salt >> (56 - i * 8);
+            iv[8 + i] = privPtr[i];
+        }
+        _aes.cfb(scopedPtr, scopedLength, iv, false);
+    }
+    if (auth)
+    {
+        uint8_t digest[SNMP_MAX_DIGEST_SIZE];
+        _hmac.compute(buf, total, digest);
+        memcpy(authPtr, digest, SNMP_V3_AUTH_PARAMS_LENGTH);
+    }
+    return total;
+}
+
+int SNMPv3Engine::unwrap(unsigned char *buf, int length, unsigned char **pdu)
+{
+    // Returns the length of the PDU left at *pdu, 0 if the message was a Report which has been consumed, or -1 on error.
+    if (!_user->isValid())
+    {
+        return -1;
+    }
+    unsigned char *end = buf + length;
+    unsigned char *ptr = buf;
+    unsigned char type;
+    unsigned int valueLength;
+    if (!berReadHeader(ptr, end, type, valueLength) || type != STRUCTURE)
+        return -1;
+    end = ptr + valueLength;
+    if (!berReadHeader(ptr, end, type, valueLength) || type != INTEGER || berReadInteger(ptr, valueLength) != SNMP_VERSION_3)
+        return -1;
+    ptr += valueLength;
+
+    // msgGlobalData
+    if (!berReadHeader(ptr, end, type, valueLength) || type != STRUCTURE)
+        return -1;
+    unsigned char *globalEnd = ptr + valueLength;
+    if (!berReadHeader(ptr, globalEnd, type, valueLength) || type != INTEGER) // msgID
+        return -1;
+    ptr += valueLength;
+    if (!berReadHeader(ptr, globalEnd, type, valueLength) || type != INTEGER) // msgMaxSize
+        return -1;
+    ptr += valueLength;
+    if (!berReadHeader(ptr, globalEnd, type, valueLength) || type != STRING || valueLength != 1)
+        return -1;
+    uint8_t flags = *ptr;
+    ptr = globalEnd;
+
+    // msgSecurityParameters
+    if (!berReadHeader(ptr, end, type, valueLength) || type != STRING)
+        return -1;
+    unsigned char *securityEnd = ptr + valueLength;
+    if (!berReadHeader(ptr, securityEnd, type, valueLength) || type != STRUCTURE)
+        return -1;
+    if (!berReadHeader(ptr, securityEnd, type, valueLength) || type != STRING || valueLength > SNMP_V3_MAX_ENGINE_ID_LENGTH)
+        return -1;
+    unsigned char *engineID = ptr;
+    int engineIDLength = valueLength;
+    ptr += valueLength;
+    if (!berReadHeader(ptr, securityEnd, type, valueLength) || type != INTEGER)
+        return -1;
+    long boots = berReadInteger(ptr, valueLength);
+    ptr += valueLength;
+    if (!berReadHeader(ptr, securityEnd, type, valueLength) || type != INTEGER)
+        return -1;
+    long time = berReadInteger(ptr, valueLength);
+    ptr += valueLength;
+    if (!berReadHeader(ptr, securityEnd, type, valueLength) || type != STRING) // msgUserName
+        return -1;
+    ptr += valueLength;
+    if (!berReadHeader(ptr, securityEnd, type, valueLength) || type != STRING)
+        return -1;
+    unsigned char *authPtr = ptr;
+    int authLength = valueLength;
+    ptr += valueLength;
+    if (!berReadHeader(ptr, securityEnd, type, valueLength) || type != STRING)
+        return -1;
+    unsigned char *privPtr = ptr;
+    int privLength = valueLength;
+    ptr = securityEnd;
+
+    if (flags & SNMP_V3_FLAG_AUTH)
+    {
+        if (!isDiscovered() || engineIDLength != _engineIDLength || memcmp(engineID, _engineID, engineIDLength) != 0 || authLength != SNMP_V3_AUTH_PARAMS_LENGTH || _user->_authProtocol == SNMP_AUTH_NONE)
+        {
+            Serial.println(F("SNMPv3 authenticated message from unknown engine"));
+            return -1;
+        }
+        uint8_t received[SNMP_V3_AUTH_PARAMS_LENGTH];
+        uint8_t digest[SNMP_MAX_DIGEST_SIZE];
+        memcpy(received, authPtr, SNMP_V3_AUTH_PARAMS_LENGTH);
+        memset(authPtr, 0, SNMP_V3_AUTH_PARAMS_LENGTH);
+        _hmac.compute(buf, end - buf, digest);
+        if (memcmp(received, digest, SNMP_V3_AUTH_PARAMS_LENGTH) != 0)
+        {
+            Serial.println(F("SNMPv3 authentication failed"));
+            return -1;
+        }
+        // RFC 3414 3.2.7: authenticated boots and time move our copy of the agent's clock forward, never back, and a message
+        // from too long ago is refused as a replay
+        if (boots > _engineBoots || (boots == _engineBoots && time > _latestReceivedTime))
+        {
+            _engineBoots = boots;
+            _engineTime = time;
+            _latestReceivedTime = time;
+            _timeSyncedAt = millis();
+        }
+        if (boots == SNMP_V3_MAX_BOOTS || boots < _engineBoots || (boots == _engineBoots && time < engineTime() - SNMP_V3_TIME_WINDOW))
+        {
+            Serial.println(F("SNMPv3 message outside the time window"));
+            return -1;
+        }
+    }
+
+    if (flags & SNMP_V3_FLAG_PRIV)
+    {
+        if (!(flags & SNMP_V3_FLAG_AUTH) || privLength != SNMP_V3_PRIV_PARAMS_LENGTH || _user->_privProtocol != SNMP_PRIV_AES)
+            return -1;
+        if (!berReadHeader(ptr, end, type, valueLength) || type != STRING)
+            return -1;
+        uint8_t iv[SNMP_AES_BLOCK_SIZE];
+        for (int i = 0; i < 4; i++)
+        {
+            iv[i] = boots >> (24 - i * 8);
+            iv[4 + i] = time >> (24 - i * 8);
+        }
+        memcpy(iv + 8, privPtr, SNMP_V3_PRIV_PARAMS_LENGTH);
+        _aes.cfb(ptr, valueLength, iv, true);
+        end = ptr + valueLength;
+    }
+
+    // scopedPDU: contextEngineID, contextName, then the PDU itself
+    if (!berReadHeader(ptr, end, type, valueLength) || type != STRUCTURE)
+        return -1;
+    end = ptr + valueLength;
+    if (!berReadHeader(ptr, end, type, valueLength) || type != STRING)
+        return -1;
+    ptr += valueLength;
+    if (!berReadHeader(ptr, end, type, valueLength) || type != STRING)
+        return -1;
+    ptr += valueLength;
+    if (ptr >= end)
+        return -1;
+
+    if (*ptr == ReportPDU)
+    {
+        if (!(flags & SNMP_V3_FLAG_AUTH) && engineIDLength > 0 && !isDiscovered())
+        {
+            // Discovery: adopt the engine ID, boots and time the agent reported and localise the keys to it. Once discovered an
+            // unauthenticated Report could be spoofed, so only authenticated messages change them.
+            memcpy(_engineID, engineID, engineIDLength);
+            _engineIDLength = engineIDLength;
+            _engineBoots = boots;
+            _engineTime = time;
+            _latestReceivedTime = time;
+            _timeSyncedAt = millis();
+            localizeKeys();
+        }
+#ifdef DEBUG
+        Serial.print(F("[DEBUG] SNMPv3 Report from: "));
+        Serial.print(ip);
+        Serial.print(F(" - Engine Boots: "));
+        Serial.print(_engineBoots);
+        Serial.print(F(" - Engine Time: "));
+        Serial.println(_engineTime);
+#endif
+        return 0;
+    }
+    if (!(flags & SNMP_V3_FLAG_AUTH) && _user->_authProtocol != SNMP_AUTH_NONE)
+    {
+        Serial.println(F("SNMPv3 unauthenticated response for authenticated user"));
+        return -1;
+    }
+    *pdu = ptr;
+    return end - ptr;
+}
+
+#endif